@@ -19,6 +19,23 @@ namespace WinampOpenALOut {
 #define CONF_EFX_ENV "EffectEnvironment"
 #define CONF_PITCH "OpenALPitch"
 #define CONF_SPLIT "Enable3D"
+#define CONF_THREADED "ThreadedOutput"
+#define CONF_AUTO_TUNE "AutoTuneBuffer"
+#define CONF_AUTO_TUNE_MIN "AutoTuneMinimum"
+#define CONF_AUTO_TUNE_MAX "AutoTuneMaximum"
+#define CONF_LOW_LATENCY "LowLatencyChunk"
+#define CONF_LOW_LATENCY_CHUNKS "LowLatencyChunks"
+#define CONF_PREBUFFER_LENGTH "PrebufferLength"
+#define CONF_FAST_START_LENGTH "FastStartLength"
+#define CONF_EXTRAPOLATE "ExtrapolatePosition"
+#define CONF_GAPLESS "Gapless"
+#define CONF_CROSSFADE "CrossfadeLength"
+#define CONF_WRITE_BATCH "WriteBatching"
+#define CONF_FLOAT_INPUT "FloatInput"
+#define CONF_FLOAT_BUS "FloatBus"
+#define CONF_BUS_BLOCK_FRAMES "BusBlockFrames"
+#define CONF_MATRIX "Matrix%uto%u"
+#define CONF_UPMIX "Upmix"
 
 #ifndef NATIVE
 	public class ConfigFile
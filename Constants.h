@@ -11,7 +11,6 @@ __CONSTANT MAX_RENDERERS = 6;
 // time constants
 __CONSTANT ZERO_TIME = 0;
 __CONSTANT ONE_SECOND_IN_MS = 1000;
-__CONSTANT CLOSE_TIMEOUT_COUNT = 10;
 
 // mask/bit constants
 __CONSTANT  THIRTY_TWO_BIT_BIT_MASK = 0xFFFFFFFF;
@@ -27,9 +26,68 @@ __CONSTANT  EMPTY_THE_BUFFER = 0;
 __CONSTANT  MINIMUM_BUFFERS = 2;
 __CONSTANT  MINIMUM_BUFFER_SIZE = 1024 * 8;
 __CONSTANT	MAXIMUM_BUFFER_SIZE = 8192;
-__CONSTANT	TEMP_BUFFER_SIZE = MAXIMUM_BUFFER_SIZE * 2;
+__CONSTANT	RING_BUFFER_BLOCKS = 4;
+// winamp writes up to this much at once, with a dsp plugin active,
+// and waits until CanWrite says all of it will fit
+__CONSTANT	MAXIMUM_WINAMP_WRITE = 8192 * 2;
+__CONSTANT	ARENA_ALIGNMENT = 32;
 __CONSTANT	MAXIMUM_BUFFER_OFFSET = 1;
-__CONSTANT	PREBUFFER_LIMIT = 3;
+__CONSTANT	WORKER_WAIT_MS = 10;
+
+// volume changes, pauses and seeks move the gain over this long so
+// they don't click, the worker wakes up this often while it does
+__CONSTANT	DECLICK_RAMP_MS = 20;
+__CONSTANT	DECLICK_STEP_MS = 2;
+
+// with write batching on CanWrite offers nothing until this much of
+// the queue, in percent, is free so winamp writes in big batches
+__CONSTANT	WRITE_BATCH_PERCENT = 40;
+
+// low latency mode, the open al buffers hold a set time of audio
+// rather than a set number of bytes and only a few are queued
+__CONSTANT	LOW_LATENCY_CHUNK_MIN = 2;
+__CONSTANT	LOW_LATENCY_CHUNK_MAX = 50;
+__CONSTANT	DEFC_LOW_LATENCY_CHUNKS = 4;
+__CONSTANT	LOW_LATENCY_CHUNKS_MAX = 32;
+
+// output clock, readings further out than this are jumped to rather
+// than smoothed. the gains are how hard each reading pulls the
+// position and the speed, which can't drift more than the limit
+__CONSTANT	CLOCK_RESYNC_MS = 100;
+__FCONSTANT	CLOCK_PHASE_GAIN = 0.1f;
+__FCONSTANT	CLOCK_RATE_GAIN = 0.01f;
+__FCONSTANT	CLOCK_RATE_LIMIT = 0.005f;
+
+// gapless mode, once winamp has given us the whole track we say
+// it's finished when this much is left to play so the next track
+// can be opened and queued behind it
+__CONSTANT	GAPLESS_HANDOVER_MS = 500;
+
+// the longest crossfade between tracks that can be set
+__CONSTANT	CROSSFADE_MAX_MS = 10000;
+
+// the published play position is refreshed by whoever asks for it
+// once it's this old, and can be moved on by at most this much
+__CONSTANT	POSITION_STALE_MS = 20;
+__CONSTANT	POSITION_EXTRAPOLATE_MS = 50;
+
+// split mode drift, sources further from the others than the
+// deadband get a pitch that would close the gap over the correction
+// time. readings are smoothed by the gain
+__CONSTANT	DRIFT_INTERVAL_MS = 50;
+__CONSTANT	DRIFT_DEADBAND_FRAMES = 2;
+__CONSTANT	DRIFT_CORRECTION_MS = 2000;
+__FCONSTANT	DRIFT_PITCH_LIMIT = 0.002f;
+__FCONSTANT	DRIFT_AVERAGE_GAIN = 0.2f;
+
+// buffer auto tuning, after an underrun the queue isn't shortened for
+// a while, otherwise it's shortened by 1/divisor every interval while
+// staying a few times longer than the jitter between writes
+__CONSTANT	TUNER_INTERVAL_MS = 5000;
+__CONSTANT	TUNER_HOLD_SECONDS = 30;
+__CONSTANT	TUNER_SHRINK_DIVISOR = 10;
+__CONSTANT	TUNER_JITTER_FACTOR = 4;
+__FCONSTANT	TUNER_AVERAGE_GAIN = 0.05f;
 
 // audio constants
 __CONSTANT  NO_SAMPLE_RATE = 0;
@@ -39,13 +97,49 @@ __CONSTANT  NO_NUMBER_OF_CHANNELS = 0;
 __CONSTANT  SHIFT_BITS_TO_BYTES = 3;
 __CONSTANT	ONE_BYTE_SAMPLE = 1;
 __CONSTANT	TWO_BYTE_SAMPLE = 2;
+__CONSTANT	THREE_BYTE_SAMPLE = 3;
 __CONSTANT	FOUR_BYTE_SAMPLE = 4;
 
 __CONSTANT	EIGHT_BIT_PER_SAMPLE = 8;
 __CONSTANT	SIXTEEN_BIT_PER_SAMPLE = 16;
+__CONSTANT	TWENTY_FOUR_BIT_PER_SAMPLE = 24;
+__CONSTANT	THIRTY_TWO_BIT_PER_SAMPLE = 32;
+
+// 24 and 32 bit audio is converted in pieces this big on its way in
+// to the ring, the dither noise has this many independent generators
+__CONSTANT	CONVERT_BUFFER_SIZE = 16384;
+__CONSTANT	DITHER_LANES = 8;
+
+// the most channels winamp can give us, and the biggest frame, part of
+// a frame at the end of a write is kept until the next one
+__CONSTANT	INPUT_MAX_CHANNELS = 8;
+__CONSTANT	INPUT_MAX_FRAME_SIZE = 4 * 8;
+
+// the float bus works on this many frames at a time so its planes
+// stay in the cache, and carries up to 7.1
+__CONSTANT	DEFC_BUS_BLOCK_FRAMES = 256;
+__CONSTANT	BUS_BLOCK_FRAMES_MIN = 16;
+__CONSTANT	BUS_BLOCK_FRAMES_MAX = 4096;
+__CONSTANT	BUS_MAX_CHANNELS = 8;
+
+// room for a mixing matrix from the config, 8 by 8 gains and the
+// name it's kept under
+__CONSTANT	MATRIX_CONFIG_SIZE = 640;
+__CONSTANT	MATRIX_CONFIG_NAME_SIZE = 16;
+
+// the stereo to 5.1 upmixer works on frames this long (21ms at 48kHz)
+// half overlapped, and sends frequencies below the cutoff to the lfe
+__CONSTANT	UPMIX_FRAME_SIZE = 1024;
+__CONSTANT	UPMIX_HOP_SIZE = 512;
+__CONSTANT	UPMIX_CHANNELS = 6;
+__CONSTANT	UPMIX_LFE_CUTOFF_HZ = 120;
+__FCONSTANT	UPMIX_SMOOTHING = 0.9f;
+__FCONSTANT	UPMIX_REAR_LEVEL = 0.70710678f;
 
 __CONSTANT	DEFC_DEVICE = 0;
 __CONSTANT	DEFC_BUFFER_LENGTH = 2000;
+__CONSTANT	DEFC_PREBUFFER_LENGTH = 150;
+__CONSTANT	DEFC_FAST_START_LENGTH = 40;
 __CONSTANT	CONF_BUFFER_LENGTH_MIN = 250;
 __CONSTANT	CONF_BUFFER_LENGTH_MAX = 6000;
 
@@ -83,6 +83,15 @@ ALenum eXRAMAuto = 0;
 ALenum eXRAMHardware = 0;
 ALenum eXRAMAccessible = 0;
 
+// AL_SOFT_deferred_updates functions
+
+LPALDEFERUPDATESSOFT alDeferUpdatesSOFT = NULL;
+LPALPROCESSUPDATESSOFT alProcessUpdatesSOFT = NULL;
+
+// AL_SOFT_source_latency functions
+
+LPALGETSOURCEI64VSOFT alGetSourcei64vSOFT = NULL;
+
 Framework::Framework()
 {
 	pDeviceList = NULL;
@@ -223,3 +232,46 @@ ALboolean Framework::ALFWIsEFXSupported()
 
 	return bEFXSupport;
 }
+
+ALboolean Framework::ALFWIsDeferredUpdatesSupported()
+{
+	ALboolean bSupport = AL_FALSE;
+
+	alDeferUpdatesSOFT = NULL;
+	alProcessUpdatesSOFT = NULL;
+
+	if (alIsExtensionPresent("AL_SOFT_deferred_updates"))
+	{
+		// Get function pointers
+		alDeferUpdatesSOFT = (LPALDEFERUPDATESSOFT)alGetProcAddress("alDeferUpdatesSOFT");
+		alProcessUpdatesSOFT = (LPALPROCESSUPDATESSOFT)alGetProcAddress("alProcessUpdatesSOFT");
+
+		if (alDeferUpdatesSOFT && alProcessUpdatesSOFT)
+			bSupport = AL_TRUE;
+	}
+
+	return bSupport;
+}
+
+ALboolean Framework::ALFWIsFloat32Supported()
+{
+	return alIsExtensionPresent("AL_EXT_FLOAT32") ? AL_TRUE : AL_FALSE;
+}
+
+ALboolean Framework::ALFWIsSourceLatencySupported()
+{
+	ALboolean bSupport = AL_FALSE;
+
+	alGetSourcei64vSOFT = NULL;
+
+	if (alIsExtensionPresent("AL_SOFT_source_latency"))
+	{
+		// Get function pointers
+		alGetSourcei64vSOFT = (LPALGETSOURCEI64VSOFT)alGetProcAddress("alGetSourcei64vSOFT");
+
+		if (alGetSourcei64vSOFT)
+			bSupport = AL_TRUE;
+	}
+
+	return bSupport;
+}
@@ -47,6 +47,9 @@ class Framework {
 
 		// Extension Queries 
 		ALboolean ALFWIsEFXSupported();
+		ALboolean ALFWIsDeferredUpdatesSupported();
+		ALboolean ALFWIsSourceLatencySupported();
+		ALboolean ALFWIsFloat32Supported();
 	protected:
 		class ALDeviceList *pDeviceList;
 		void *ptrContext;
@@ -110,4 +113,25 @@ extern LPEAXGETBUFFERMODE eaxGetBufferMode;
 extern ALenum eXRAMSize, eXRAMFree;
 extern ALenum eXRAMAuto, eXRAMHardware, eXRAMAccessible;
 
+// AL_SOFT_deferred_updates function pointer variables
+
+typedef void (__cdecl *LPALDEFERUPDATESSOFT)(void);
+typedef void (__cdecl *LPALPROCESSUPDATESSOFT)(void);
+
+extern LPALDEFERUPDATESSOFT alDeferUpdatesSOFT;
+extern LPALPROCESSUPDATESSOFT alProcessUpdatesSOFT;
+
+// AL_SOFT_source_latency types, enum values and function pointer variables
+
+#ifndef AL_SOFT_source_latency
+typedef __int64 ALint64SOFT;
+
+#define AL_SAMPLE_OFFSET_LATENCY_SOFT	0x1200
+#define AL_SEC_OFFSET_LATENCY_SOFT		0x1201
+#endif
+
+typedef void (__cdecl *LPALGETSOURCEI64VSOFT)(ALuint source, ALenum param, ALint64SOFT *values);
+
+extern LPALGETSOURCEI64VSOFT alGetSourcei64vSOFT;
+
 #endif _FRAMEWORK_H_
\ No newline at end of file
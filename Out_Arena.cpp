@@ -0,0 +1,91 @@
+#include "Out_Arena.h"
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+namespace WinampOpenALOut
+{
+	Output_Arena::Output_Arena()
+	{
+		storage = NULL;
+		storage_size = 0;
+		capacity = 0;
+		used = 0;
+		high_water = 0;
+	}
+
+	Output_Arena::~Output_Arena()
+	{
+		if ( storage != NULL )
+		{
+			_aligned_free(storage);
+			storage = NULL;
+		}
+	}
+
+	/*
+		open
+
+		make sure there's (size) bytes to hand out, the storage is
+		kept between streams so this only allocates if it has to grow
+	*/
+	bool Output_Arena::Open(const unsigned int size)
+	{
+		const unsigned int new_size = 
+			(size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+		if ( new_size > storage_size )
+		{
+			if ( storage != NULL )
+			{
+				_aligned_free(storage);
+			}
+
+			storage = (char*)_aligned_malloc(new_size, ARENA_ALIGNMENT);
+			storage_size = (storage != NULL) ? new_size : 0;
+		}
+
+		capacity = storage_size;
+		used = 0;
+		high_water = 0;
+
+		return storage != NULL;
+	}
+
+	void Output_Arena::Close()
+	{
+		capacity = 0;
+		used = 0;
+	}
+
+	/*
+		allocate
+
+		hand out (size) bytes, aligned for the SIMD routines.
+		returns NULL if the arena wasn't sized big enough
+	*/
+	char* Output_Arena::Allocate(const unsigned int size)
+	{
+		const unsigned int aligned_size =
+			(size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+		if ( aligned_size > capacity - used )
+		{
+#ifdef _DEBUG
+			_ASSERTE( !"Output_Arena is too small" );
+#endif
+			return NULL;
+		}
+
+		char * p = storage + used;
+		used += aligned_size;
+
+		if ( used > high_water )
+		{
+			high_water = used;
+		}
+
+		return p;
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef OUT_ARENA_H
+#define OUT_ARENA_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * Scratch memory for one stream. It's sized when the stream is
+	 * opened and every stage of the audio path takes its working
+	 * buffers from here instead of the heap. Everything handed out
+	 * is given back in one go with Reset once a block is written.
+	 */
+#ifndef NATIVE
+	public class Output_Arena
+#else
+	class Output_Arena
+#endif
+	{
+	public:
+		Output_Arena();
+		~Output_Arena();
+
+		bool Open(const unsigned int size);
+		void Close();
+
+		char* Allocate(const unsigned int size);
+
+		inline void Reset()						{ used = 0; }
+		inline unsigned int GetUsed()			{ return used; }
+		inline unsigned int GetCapacity()		{ return capacity; }
+		inline unsigned int GetHighWater()		{ return high_water; }
+
+	protected:
+
+		char			*storage;
+		unsigned int	storage_size;
+
+		unsigned int	capacity;
+		unsigned int	used;
+		unsigned int	high_water;
+	};
+}
+
+#endif
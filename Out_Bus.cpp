@@ -0,0 +1,260 @@
+#include "Out_Bus.h"
+#include "Out_Dsp.h"
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+namespace WinampOpenALOut
+{
+	Output_Bus::Output_Bus()
+	{
+		input_channels = 0;
+		output_channels = 0;
+		sample_size = 0;
+		block_frames = 0;
+
+		for ( unsigned int c = 0 ; c < BUS_MAX_CHANNELS ; c++ )
+		{
+			planes[c] = NULL;
+			samples[c] = NULL;
+			mixed[c] = NULL;
+			route[c] = 0;
+		}
+
+		mixing = false;
+		upmix = NULL;
+	}
+
+	/*
+		open
+
+		set the bus up for a stream, this is the only time it
+		allocates. (sample_size) is what's in the ring and what
+		the renderers take
+	*/
+	bool Output_Bus::Open(
+		const unsigned int a_input_channels,
+		const unsigned int a_output_channels,
+		const unsigned int a_sample_size,
+		const unsigned int a_block_frames)
+	{
+		if ( a_input_channels == 0 || a_input_channels > BUS_MAX_CHANNELS ||
+			a_output_channels == 0 || a_output_channels > BUS_MAX_CHANNELS )
+		{
+			return false;
+		}
+
+		input_channels = a_input_channels;
+		output_channels = a_output_channels;
+		sample_size = a_sample_size;
+		block_frames = a_block_frames;
+
+		const unsigned int plane_size = block_frames * FOUR_BYTE_SAMPLE;
+		const unsigned int sample_planes = 
+			(input_channels > output_channels) ? input_channels : output_channels;
+
+		const unsigned int total_planes = 
+			input_channels + sample_planes + output_channels;
+
+		if ( !memory.Open(
+			(total_planes * plane_size) + (total_planes * ARENA_ALIGNMENT)) )
+		{
+			return false;
+		}
+
+		for ( unsigned int c = 0 ; c < input_channels ; c++ )
+		{
+			planes[c] = (float*)memory.Allocate(plane_size);
+		}
+
+		for ( unsigned int c = 0 ; c < sample_planes ; c++ )
+		{
+			samples[c] = memory.Allocate(plane_size);
+		}
+
+		for ( unsigned int c = 0 ; c < output_channels ; c++ )
+		{
+			mixed[c] = (float*)memory.Allocate(plane_size);
+			route[c] = c % input_channels;
+		}
+
+		mixing = false;
+		upmix = NULL;
+
+		return true;
+	}
+
+	void Output_Bus::Close()
+	{
+		memory.Close();
+
+		input_channels = 0;
+		output_channels = 0;
+		mixing = false;
+		upmix = NULL;
+	}
+
+	void Output_Bus::SetRoute(const unsigned int output, const unsigned int input)
+	{
+		if ( output < output_channels && input < input_channels )
+		{
+			route[output] = input;
+		}
+	}
+
+	void Output_Bus::SetMatrix(const float *coefficients)
+	{
+		if ( output_channels == 0 )
+		{
+			return;
+		}
+
+		mixing = !Output_Matrix::IsRouting(
+			input_channels,
+			output_channels,
+			coefficients,
+			route);
+
+		if ( mixing )
+		{
+			memcpy_s(
+				matrix,
+				sizeof(matrix),
+				coefficients,
+				input_channels * output_channels * sizeof(float));
+		}
+	}
+
+	void Output_Bus::SetUpmix(Output_Upmix *a_upmix)
+	{
+		if ( a_upmix == NULL || 
+			(input_channels == 2 && output_channels == UPMIX_CHANNELS) )
+		{
+			upmix = a_upmix;
+		}
+	}
+
+	/*
+		process
+
+		run (frames) of interleaved audio through the bus a block of
+		(block_frames) at a time, so the planes stay in the cache.
+		each block is loaded in to float planes, upmixed or mixed to
+		the output layout if it needs to be, then stored back out to
+		(dst) interleaved, or one buffer per channel if (split)
+	*/
+	void Output_Bus::Process(
+		const char *src,
+		const unsigned int frames,
+		char **dst,
+		const bool split)
+	{
+		const unsigned int input_frame_size = sample_size * input_channels;
+
+		for ( unsigned int offset = 0 ; offset < frames ; offset += block_frames )
+		{
+			unsigned int count = frames - offset;
+			if ( count > block_frames )
+			{
+				count = block_frames;
+			}
+
+			Load(src + (offset * input_frame_size), count);
+
+			/*
+			 * anything that works on the whole bus goes here, in
+			 * place on (planes)
+			 */
+
+			if ( upmix != NULL )
+			{
+				upmix->Process(planes[0], planes[1], count, mixed);
+			}
+			else if ( mixing )
+			{
+				Mix(count);
+			}
+
+			Store(dst, offset, count, split);
+		}
+	}
+
+	/*
+		load
+
+		interleaved samples in to float planes, float audio goes
+		straight in to the planes
+	*/
+	void Output_Bus::Load(const char *src, const unsigned int frames)
+	{
+		if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			Output_Dsp::Deinterleave(src, frames, input_channels, sample_size, (char**)planes);
+			return;
+		}
+
+		Output_Dsp::Deinterleave(src, frames, input_channels, sample_size, samples);
+
+		for ( unsigned int c = 0 ; c < input_channels ; c++ )
+		{
+			Output_Dsp::ToFloat(samples[c], frames, sample_size, planes[c]);
+		}
+	}
+
+	/*
+		mix
+
+		every output plane from the input planes through the matrix
+	*/
+	void Output_Bus::Mix(const unsigned int frames)
+	{
+		for ( unsigned int c = 0 ; c < output_channels ; c++ )
+		{
+			Output_Dsp::MixPlanes(
+				(const float**)planes,
+				matrix + (c * input_channels),
+				input_channels,
+				frames,
+				mixed[c]);
+		}
+	}
+
+	/*
+		store
+
+		float planes back to samples for the renderers, (offset) is
+		how many frames in to (dst) this piece goes
+	*/
+	void Output_Bus::Store(
+		char **dst,
+		const unsigned int offset,
+		const unsigned int frames,
+		const bool split)
+	{
+		if ( split )
+		{
+			for ( unsigned int c = 0 ; c < output_channels ; c++ )
+			{
+				Output_Dsp::FromFloat(
+					GetOutputPlane(c),
+					frames,
+					sample_size,
+					dst[c] + (offset * sample_size));
+			}
+			return;
+		}
+
+		for ( unsigned int c = 0 ; c < output_channels ; c++ )
+		{
+			Output_Dsp::FromFloat(GetOutputPlane(c), frames, sample_size, samples[c]);
+		}
+
+		Output_Dsp::Interleave(
+			(const char**)samples,
+			frames,
+			output_channels,
+			sample_size,
+			dst[0] + (offset * sample_size * output_channels));
+	}
+}
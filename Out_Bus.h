@@ -0,0 +1,103 @@
+#ifndef OUT_BUS_H
+#define OUT_BUS_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+#include "Out_Arena.h"
+#include "Out_Matrix.h"
+#include "Out_Upmix.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * The float bus. A block from the ring is converted once to planar
+	 * float, one buffer per channel, and converted once more to the
+	 * format the renderers take on its way out. In between every stage
+	 * only deals with aligned float planes. Blocks go through a few
+	 * frames at a time so the planes stay in the cache.
+	 */
+#ifndef NATIVE
+	public class Output_Bus
+#else
+	class Output_Bus
+#endif
+	{
+	public:
+		Output_Bus();
+
+		bool Open(
+			const unsigned int a_input_channels,
+			const unsigned int a_output_channels,
+			const unsigned int a_sample_size,
+			const unsigned int a_block_frames);
+		void Close();
+
+		// which input channel feeds (output), by default they're
+		// repeated across the outputs the way expansion does it
+		void SetRoute(const unsigned int output, const unsigned int input);
+
+		/*
+		 * mix the outputs from the inputs with an Output_Matrix, a
+		 * matrix that only copies channels is turned in to a route
+		 */
+		void SetMatrix(const float *coefficients);
+		inline bool IsMixing()						{ return mixing; }
+
+		/*
+		 * upmix stereo to 5.1 with (a_upmix) instead of a matrix,
+		 * NULL to stop. the bus has to be open for 2 in and
+		 * UPMIX_CHANNELS out
+		 */
+		void SetUpmix(class Output_Upmix *a_upmix);
+
+		/*
+		 * take (frames) of interleaved audio from (src) through the
+		 * bus. (dst) is one interleaved buffer, or one buffer for
+		 * each output channel if (split)
+		 */
+		void Process(
+			const char *src,
+			const unsigned int frames,
+			char **dst,
+			const bool split);
+
+		inline unsigned int GetBlockFrames()		{ return block_frames; }
+
+	protected:
+
+		void Load(const char *src, const unsigned int frames);
+		void Mix(const unsigned int frames);
+
+		inline float* GetOutputPlane(const unsigned int c)
+		{
+			return (mixing || upmix != NULL) ? mixed[c] : planes[route[c]];
+		}
+
+		void Store(
+			char **dst,
+			const unsigned int offset,
+			const unsigned int frames,
+			const bool split);
+
+		// the planes, and the samples they're converted through
+		Output_Arena	memory;
+		float			*planes[BUS_MAX_CHANNELS];
+		char			*samples[BUS_MAX_CHANNELS];
+
+		unsigned int	route[BUS_MAX_CHANNELS];
+
+		// the output planes when there's a matrix to mix through
+		float			*mixed[BUS_MAX_CHANNELS];
+		float			matrix[BUS_MAX_CHANNELS * BUS_MAX_CHANNELS];
+		bool			mixing;
+
+		class Output_Upmix	*upmix;
+
+		unsigned int	input_channels;
+		unsigned int	output_channels;
+		unsigned int	sample_size;
+		unsigned int	block_frames;
+	};
+}
+
+#endif
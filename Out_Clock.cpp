@@ -0,0 +1,139 @@
+#include "Out_Clock.h"
+#include "Out_Stats.h"
+
+namespace WinampOpenALOut
+{
+	Output_Clock::Output_Clock()
+	{
+		sample_rate = 0;
+		estimate_ms = 0.0;
+		rate = 1.0;
+		last_update = 0.0;
+		locked = false;
+		last_position = 0;
+	}
+
+	/*
+		start
+
+		begin counting from (position_ms), used on open and after
+		every seek
+	*/
+	void Output_Clock::Start(const unsigned int a_sample_rate, const int position_ms)
+	{
+		sample_rate = a_sample_rate;
+		estimate_ms = (double)position_ms;
+		rate = 1.0;
+		last_update = Output_Stats::GetSeconds();
+		locked = false;
+		last_position = position_ms;
+	}
+
+	void Output_Clock::Stop()
+	{
+		sample_rate = 0;
+		locked = false;
+		last_position = 0;
+	}
+
+	/*
+		update
+
+		the reading from open al only moves when the mixer runs, so
+		between mixes the loop predicts where we are from the time
+		that's passed and pulls the prediction towards each reading
+	*/
+	int Output_Clock::Update(
+		const unsigned __int64 frames,
+		const __int64 latency_ns,
+		const bool running)
+	{
+		if ( sample_rate == 0 )
+		{
+			return last_position;
+		}
+
+		const double now = Output_Stats::GetSeconds();
+		const double elapsed = now - last_update;
+		last_update = now;
+
+		// what open al says is being heard right now
+		double measured_ms = (double)FramesToMs(frames, sample_rate) -
+			((double)latency_ns / 1000000.0);
+
+		if ( measured_ms < 0.0 )
+		{
+			measured_ms = 0.0;
+		}
+
+		if ( !running )
+		{
+			// nothing is moving so there's nothing to predict
+			estimate_ms = measured_ms;
+			rate = 1.0;
+			locked = false;
+			last_position = (int)estimate_ms;
+			return last_position;
+		}
+
+		const double predicted_ms = estimate_ms + (elapsed * ONE_SECOND_IN_MS * rate);
+		const double error_ms = measured_ms - predicted_ms;
+
+		if ( !locked ||
+			error_ms > CLOCK_RESYNC_MS ||
+			error_ms < -((double)CLOCK_RESYNC_MS) )
+		{
+			// too far out (or just started), jump straight there
+			estimate_ms = measured_ms;
+			rate = 1.0;
+			locked = true;
+		}
+		else
+		{
+			estimate_ms = predicted_ms + (error_ms * CLOCK_PHASE_GAIN);
+			rate += (error_ms / ONE_SECOND_IN_MS) * CLOCK_RATE_GAIN;
+
+			if ( rate > 1.0 + CLOCK_RATE_LIMIT )
+			{
+				rate = 1.0 + CLOCK_RATE_LIMIT;
+			}
+			else if ( rate < 1.0 - CLOCK_RATE_LIMIT )
+			{
+				rate = 1.0 - CLOCK_RATE_LIMIT;
+			}
+		}
+
+		// never go backwards while playing
+		const int position = (int)estimate_ms;
+		if ( position > last_position )
+		{
+			last_position = position;
+		}
+
+		return last_position;
+	}
+
+	__int64 Output_Clock::FramesToMs(
+		const unsigned __int64 frames,
+		const unsigned int sample_rate)
+	{
+		if ( sample_rate == 0 )
+		{
+			return 0;
+		}
+
+		return (__int64)((frames * ONE_SECOND_IN_MS) / sample_rate);
+	}
+
+	unsigned __int64 Output_Clock::MsToFrames(
+		const __int64 ms,
+		const unsigned int sample_rate)
+	{
+		if ( ms <= 0 )
+		{
+			return 0;
+		}
+
+		return ((unsigned __int64)ms * sample_rate) / ONE_SECOND_IN_MS;
+	}
+}
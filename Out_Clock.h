@@ -0,0 +1,64 @@
+#ifndef OUT_CLOCK_H
+#define OUT_CLOCK_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * The play position of one stream. Positions are kept in frames
+	 * and only turned in to milliseconds at the edges, using the real
+	 * sample rate rather than rate / 1000. Readings from open al are
+	 * put through a small phase locked loop so the time winamp sees
+	 * runs smoothly and never goes backwards while playing.
+	 */
+#ifndef NATIVE
+	public class Output_Clock
+#else
+	class Output_Clock
+#endif
+	{
+	public:
+		Output_Clock();
+
+		void Start(const unsigned int a_sample_rate, const int position_ms);
+		void Stop();
+
+		/*
+		 * give the clock a new reading, (frames) played by the source
+		 * and (latency_ns) until they're heard. (running) is false if
+		 * the sources are paused or haven't started. returns the
+		 * position in ms.
+		 */
+		int Update(
+			const unsigned __int64 frames,
+			const __int64 latency_ns,
+			const bool running);
+
+		inline int GetPosition()				{ return last_position; }
+		inline double GetRate()					{ return rate; }
+
+		static __int64 FramesToMs(
+			const unsigned __int64 frames,
+			const unsigned int sample_rate);
+
+		static unsigned __int64 MsToFrames(
+			const __int64 ms,
+			const unsigned int sample_rate);
+
+	protected:
+
+		unsigned int	sample_rate;
+
+		// where the loop thinks we are and how fast it's moving
+		double			estimate_ms;
+		double			rate;
+		double			last_update;
+		bool			locked;
+
+		int				last_position;
+	};
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include "Out_Drift.h"
+#include "Out_Stats.h"
+
+namespace WinampOpenALOut
+{
+	Output_Drift::Output_Drift()
+	{
+		Start(0);
+	}
+
+	/*
+		start
+
+		called when a stream opens, the new sources all start at
+		their normal pitch
+	*/
+	void Output_Drift::Start(const unsigned int a_sample_rate)
+	{
+		sample_rate = a_sample_rate;
+		last_update = 0.0;
+		settled = false;
+
+		for ( int source = 0 ; source < MAX_RENDERERS ; source++ )
+		{
+			error[source] = 0.0;
+			trim[source] = 1.0f;
+		}
+
+		skew_ms = 0.0;
+		maximum_skew_ms = 0.0;
+		corrections = 0;
+	}
+
+	/*
+		update
+
+		only looks at the sources every DRIFT_INTERVAL_MS, the
+		offsets open al gives back only move when the mixer runs so
+		they're smoothed before being acted on. a source that is
+		(error) frames ahead is slowed down by enough to lose them
+		over DRIFT_CORRECTION_MS, but never by more than the limit
+	*/
+	bool Output_Drift::Update(
+		const unsigned __int64 *frames,
+		const int count,
+		float *pitch)
+	{
+		if ( sample_rate == 0 || count < 2 || count > (int)MAX_RENDERERS )
+		{
+			return false;
+		}
+
+		const double now = Output_Stats::GetSeconds();
+		if ( (now - last_update) * ONE_SECOND_IN_MS < DRIFT_INTERVAL_MS )
+		{
+			return false;
+		}
+		last_update = now;
+
+		// work relative to the first source so nothing overflows
+		double offset[MAX_RENDERERS];
+		double average = 0.0;
+
+		for ( int source = 0 ; source < count ; source++ )
+		{
+			offset[source] = (double)(__int64)(frames[source] - frames[0]);
+			average += offset[source];
+		}
+		average /= count;
+
+		double lowest = offset[0];
+		double highest = offset[0];
+		bool changed = false;
+
+		for ( int source = 0 ; source < count ; source++ )
+		{
+			if ( offset[source] < lowest )
+			{
+				lowest = offset[source];
+			}
+			if ( offset[source] > highest )
+			{
+				highest = offset[source];
+			}
+
+			const double ahead = offset[source] - average;
+
+			if ( settled )
+			{
+				error[source] += (ahead - error[source]) * DRIFT_AVERAGE_GAIN;
+			}
+			else
+			{
+				error[source] = ahead;
+			}
+
+			float new_trim = 1.0f;
+
+			if ( error[source] > DRIFT_DEADBAND_FRAMES ||
+				error[source] < -(double)DRIFT_DEADBAND_FRAMES )
+			{
+				double change = 
+					error[source] / (((double)sample_rate * DRIFT_CORRECTION_MS) / ONE_SECOND_IN_MS);
+
+				if ( change > DRIFT_PITCH_LIMIT )
+				{
+					change = DRIFT_PITCH_LIMIT;
+				}
+				else if ( change < -DRIFT_PITCH_LIMIT )
+				{
+					change = -DRIFT_PITCH_LIMIT;
+				}
+
+				new_trim = (float)(1.0 - change);
+			}
+
+			if ( new_trim != trim[source] )
+			{
+				if ( trim[source] == 1.0f )
+				{
+					corrections++;
+				}
+
+				trim[source] = new_trim;
+				changed = true;
+			}
+
+			pitch[source] = trim[source];
+		}
+
+		settled = true;
+
+		skew_ms = ((highest - lowest) * ONE_SECOND_IN_MS) / sample_rate;
+		if ( skew_ms > maximum_skew_ms )
+		{
+			maximum_skew_ms = skew_ms;
+		}
+
+		return changed;
+	}
+}
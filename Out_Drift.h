@@ -0,0 +1,58 @@
+#ifndef OUT_DRIFT_H
+#define OUT_DRIFT_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * Keeps the sources of split mode in step. Every renderer plays
+	 * its own source so nothing ties their positions together once
+	 * they've started. Each reading compares every source against
+	 * the average of all of them and works out a pitch for it that
+	 * will pull it back, small enough not to be heard.
+	 */
+#ifndef NATIVE
+	public class Output_Drift
+#else
+	class Output_Drift
+#endif
+	{
+	public:
+		Output_Drift();
+
+		void Start(const unsigned int a_sample_rate);
+
+		/*
+		 * give the supervisor the frames each source has played,
+		 * (pitch) is filled in with what each should be set to.
+		 * returns true if any of them have changed
+		 */
+		bool Update(
+			const unsigned __int64 *frames,
+			const int count,
+			float *pitch);
+
+		// furthest apart the sources are, now and since Start
+		inline double GetSkewMs()				{ return skew_ms; }
+		inline double GetMaximumSkewMs()		{ return maximum_skew_ms; }
+		inline unsigned int GetCorrections()	{ return corrections; }
+
+	protected:
+
+		unsigned int	sample_rate;
+		double			last_update;
+
+		// how far each source is ahead of the others, smoothed
+		double			error[MAX_RENDERERS];
+		float			trim[MAX_RENDERERS];
+		bool			settled;
+
+		double			skew_ms;
+		double			maximum_skew_ms;
+		unsigned int	corrections;
+	};
+}
+
+#endif
@@ -0,0 +1,2233 @@
+#include "Out_Dsp.h"
+
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <math.h>
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+#define SELF_TEST_FRAMES 77
+#define SELF_TEST_CHANNELS 8
+#define SELF_TEST_MAX_SIZE (SELF_TEST_FRAMES * SELF_TEST_CHANNELS * TWO_BYTE_SAMPLE)
+#define SELF_TEST_FFT_SIZE 64
+
+// the gains of a crossfade only change every so many frames
+#define FADE_STEP_FRAMES 32
+#define HALF_PI 1.57079632679489661923
+
+// how much each conversion is timed over
+#define MEASURE_SAMPLES 4096
+#define MEASURE_PASSES 256
+
+namespace WinampOpenALOut
+{
+	dsp_level Output_Dsp::supported = DSP_SCALAR;
+	dsp_level Output_Dsp::level = DSP_SCALAR;
+
+	/*
+		initialise
+
+		ask the cpu what it can do, AVX2 also needs the OS to
+		save the upper half of the registers on a context switch
+	*/
+	void Output_Dsp::Initialise()
+	{
+		int info[4] = {0, 0, 0, 0};
+
+		supported = DSP_SCALAR;
+
+		__cpuid(info, 0);
+		const int max_leaf = info[0];
+
+		__cpuid(info, 1);
+		const bool has_sse2 = (info[3] & (1 << 26)) != 0;
+		const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+		const bool has_avx = (info[2] & (1 << 28)) != 0;
+
+		if ( has_sse2 )
+		{
+			supported = DSP_SSE2;
+
+			if ( has_osxsave && has_avx && max_leaf >= 7 &&
+				(_xgetbv(0) & 0x6) == 0x6 )
+			{
+				__cpuidex(info, 7, 0);
+				if ( info[1] & (1 << 5) )
+				{
+					supported = DSP_AVX2;
+				}
+			}
+		}
+
+		level = supported;
+
+#ifdef _DEBUG
+		_ASSERTE( SelfTest() );
+#endif
+	}
+
+	/*
+		set level
+
+		use a lower level than the cpu supports, never a higher one
+	*/
+	void Output_Dsp::SetLevel(const dsp_level a_level)
+	{
+		level = (a_level < supported) ? a_level : supported;
+	}
+
+	/*
+	 * ######################## scalar versions
+	 *
+	 * these are also used to finish off the frames at the end of a
+	 * buffer that don't make up a whole vector
+	 */
+	template <typename sample_type>
+	static void DeinterleaveScalar(
+		const sample_type *src,
+		const unsigned int start,
+		const unsigned int frames,
+		const unsigned int channels,
+		char **dst)
+	{
+		const sample_type *in = src + (start * channels);
+
+		for ( unsigned int frame = start ; frame < frames ; frame++ )
+		{
+			for ( unsigned int c = 0 ; c < channels ; c++ )
+			{
+				((sample_type*)dst[c])[frame] = in[c];
+			}
+			in += channels;
+		}
+	}
+
+	/*
+	 * copy each sample (mono) or each frame (stereo) in to the
+	 * output a number of times. (element_type) is the size of
+	 * what's being copied: a sample for mono, a frame for stereo
+	 */
+	template <typename element_type, unsigned int copies>
+	static void DuplicateScalar(
+		const element_type *src,
+		const unsigned int start,
+		const unsigned int count,
+		element_type *dst)
+	{
+		element_type *out = dst + (start * copies);
+
+		for ( unsigned int i = start ; i < count ; i++ )
+		{
+			for ( unsigned int copy = 0 ; copy < copies ; copy++ )
+			{
+				*out++ = src[i];
+			}
+		}
+	}
+
+	/*
+	 * round the same way the vector versions do
+	 */
+	static inline int RoundToInt(const float value)
+	{
+		return _mm_cvtss_si32(_mm_set_ss(value));
+	}
+
+	static void CrossFade16Scalar(
+		short *dst,
+		const short *src,
+		const unsigned int start,
+		const unsigned int count,
+		const float out_gain,
+		const float in_gain)
+	{
+		for ( unsigned int i = start ; i < count ; i++ )
+		{
+			const float a = (float)dst[i] * out_gain;
+			const float b = (float)src[i] * in_gain;
+			int mixed = RoundToInt(a + b);
+
+			if ( mixed > 32767 )
+			{
+				mixed = 32767;
+			}
+			else if ( mixed < -32768 )
+			{
+				mixed = -32768;
+			}
+
+			dst[i] = (short)mixed;
+		}
+	}
+
+	// 8 bit audio is unsigned with silence at 128
+	static void CrossFade8Scalar(
+		unsigned char *dst,
+		const unsigned char *src,
+		const unsigned int count,
+		const float out_gain,
+		const float in_gain)
+	{
+		for ( unsigned int i = 0 ; i < count ; i++ )
+		{
+			const float a = (float)((int)dst[i] - 128) * out_gain;
+			const float b = (float)((int)src[i] - 128) * in_gain;
+			int mixed = RoundToInt(a + b) + 128;
+
+			if ( mixed > 255 )
+			{
+				mixed = 255;
+			}
+			else if ( mixed < 0 )
+			{
+				mixed = 0;
+			}
+
+			dst[i] = (unsigned char)mixed;
+		}
+	}
+
+	static void CrossFadeFloatScalar(
+		float *dst,
+		const float *src,
+		const unsigned int start,
+		const unsigned int count,
+		const float out_gain,
+		const float in_gain)
+	{
+		for ( unsigned int i = start ; i < count ; i++ )
+		{
+			dst[i] = (dst[i] * out_gain) + (src[i] * in_gain);
+		}
+	}
+
+	/*
+	 * the float bus scales by powers of two so 8 and 16 bit samples
+	 * survive the trip to float and back exactly
+	 */
+	static const float FROM_16 = 1.0f / 32768.0f;
+	static const float TO_16 = 32768.0f;
+	static const float FROM_8 = 1.0f / 128.0f;
+	static const float TO_8 = 128.0f;
+
+	static void ToFloatScalar(
+		const char *src,
+		const unsigned int start,
+		const unsigned int samples,
+		const unsigned int sample_size,
+		float *dst)
+	{
+		for ( unsigned int i = start ; i < samples ; i++ )
+		{
+			if ( sample_size == TWO_BYTE_SAMPLE )
+			{
+				dst[i] = (float)((const short*)src)[i] * FROM_16;
+			}
+			else
+			{
+				dst[i] = (float)((int)((const unsigned char*)src)[i] - 128) * FROM_8;
+			}
+		}
+	}
+
+	static void FromFloatScalar(
+		const float *src,
+		const unsigned int start,
+		const unsigned int samples,
+		const unsigned int sample_size,
+		char *dst)
+	{
+		const int limit = (sample_size == TWO_BYTE_SAMPLE) ? 32767 : 127;
+		const float scale = (sample_size == TWO_BYTE_SAMPLE) ? TO_16 : TO_8;
+
+		for ( unsigned int i = start ; i < samples ; i++ )
+		{
+			int value = RoundToInt(src[i] * scale);
+
+			if ( value > limit )
+			{
+				value = limit;
+			}
+			else if ( value < -limit - 1 )
+			{
+				value = -limit - 1;
+			}
+
+			if ( sample_size == TWO_BYTE_SAMPLE )
+			{
+				((short*)dst)[i] = (short)value;
+			}
+			else
+			{
+				((unsigned char*)dst)[i] = (unsigned char)(value + 128);
+			}
+		}
+	}
+
+	template <typename sample_type>
+	static void InterleaveScalar(
+		const char **src,
+		const unsigned int start,
+		const unsigned int frames,
+		const unsigned int channels,
+		char *dst)
+	{
+		sample_type *out = ((sample_type*)dst) + (start * channels);
+
+		for ( unsigned int frame = start ; frame < frames ; frame++ )
+		{
+			for ( unsigned int c = 0 ; c < channels ; c++ )
+			{
+				*out++ = ((const sample_type*)src[c])[frame];
+			}
+		}
+	}
+
+	/*
+	 * every version adds the inputs up in the same order starting from
+	 * 0, so they all give exactly the same answer
+	 */
+	static void MixPlanesScalar(
+		const float **src,
+		const float *gains,
+		const unsigned int inputs,
+		const unsigned int start,
+		const unsigned int frames,
+		float *dst)
+	{
+		for ( unsigned int i = start ; i < frames ; i++ )
+		{
+			float sum = 0.0f;
+
+			for ( unsigned int c = 0 ; c < inputs ; c++ )
+			{
+				sum += src[c][i] * gains[c];
+			}
+
+			dst[i] = sum;
+		}
+	}
+
+	/*
+	 * one stage of butterflies, (half) apart. the twiddles for the
+	 * stage are kept together from (half) on
+	 */
+	static void FftStageScalar(
+		float *re,
+		float *im,
+		const unsigned int size,
+		const unsigned int half,
+		const float *twiddles)
+	{
+		const float *twiddle_re = twiddles + half;
+		const float *twiddle_im = twiddles + size + half;
+
+		for ( unsigned int group = 0 ; group < size ; group += half * 2 )
+		{
+			for ( unsigned int k = 0 ; k < half ; k++ )
+			{
+				const unsigned int a = group + k;
+				const unsigned int b = a + half;
+
+				const float tr = (re[b] * twiddle_re[k]) - (im[b] * twiddle_im[k]);
+				const float ti = (re[b] * twiddle_im[k]) + (im[b] * twiddle_re[k]);
+
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] = re[a] + tr;
+				im[a] = im[a] + ti;
+			}
+		}
+	}
+
+	/*
+	 * every format is converted through float. 24 and 32 bit samples
+	 * are scaled by a power of two so nothing is lost on the way
+	 */
+	static const float INT32_SCALE = 1.0f / 2147483648.0f;
+	static const float FLOAT_TO_16 = 32767.0f;
+	static const float DITHER_SCALE = 1.0f / 65536.0f;
+
+	// 24 bit samples are little endian, put them in the top of an int
+	static inline int Load24(const unsigned char *p)
+	{
+		return (int)(((unsigned int)p[0] << 8) | 
+			((unsigned int)p[1] << 16) | 
+			((unsigned int)p[2] << 24));
+	}
+
+	static inline float LoadSample(
+		const char *src,
+		const unsigned int i,
+		const sample_format format)
+	{
+		switch ( format )
+		{
+		case SAMPLE_PCM24:
+			return (float)Load24((const unsigned char*)src + (i * THREE_BYTE_SAMPLE)) * INT32_SCALE;
+		case SAMPLE_PCM32:
+			return (float)((const int*)src)[i] * INT32_SCALE;
+		default:
+			return ((const float*)src)[i];
+		}
+	}
+
+	// xorshift, the state must never be 0
+	static inline unsigned int NextRandom(unsigned int x)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return x;
+	}
+
+	/*
+	 * triangular noise of up to one step either way, the difference
+	 * between the two halves of one random number. sample (i) always
+	 * uses generator (i % DITHER_LANES) so the vector versions make
+	 * exactly the same noise
+	 */
+	static inline float DitherNoise(unsigned int *state)
+	{
+		*state = NextRandom(*state);
+		return ((float)(int)(*state >> 16) - (float)(int)(*state & 0xFFFF)) * DITHER_SCALE;
+	}
+
+	static void ConvertToFloatScalar(
+		const char *src,
+		const unsigned int start,
+		const unsigned int samples,
+		const sample_format format,
+		float *dst)
+	{
+		for ( unsigned int i = start ; i < samples ; i++ )
+		{
+			dst[i] = LoadSample(src, i, format);
+		}
+	}
+
+	static void ConvertTo16Scalar(
+		const char *src,
+		const unsigned int start,
+		const unsigned int samples,
+		const sample_format format,
+		short *dst,
+		unsigned int *dither)
+	{
+		for ( unsigned int i = start ; i < samples ; i++ )
+		{
+			const float scaled = LoadSample(src, i, format) * FLOAT_TO_16;
+			int value = RoundToInt(scaled + DitherNoise(&dither[i % DITHER_LANES]));
+
+			if ( value > 32767 )
+			{
+				value = 32767;
+			}
+			else if ( value < -32768 )
+			{
+				value = -32768;
+			}
+
+			dst[i] = (short)value;
+		}
+	}
+
+	// 8 bit fits exactly in the top byte of 16 bit, no dither needed
+	static void Widen8To16Scalar(
+		const unsigned char *src,
+		const unsigned int start,
+		const unsigned int samples,
+		short *dst)
+	{
+		for ( unsigned int i = start ; i < samples ; i++ )
+		{
+			dst[i] = (short)(((int)src[i] - 128) << 8);
+		}
+	}
+
+	/*
+	 * ######################## SSE2 versions
+	 */
+
+	/*
+	 * transpose an 8x8 matrix of 16 bit values, rows in, columns out
+	 */
+	static inline void Transpose8x8Epi16(__m128i *r)
+	{
+		const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+		const __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+		const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+		const __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+		const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+		const __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+		const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+		const __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+		const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+		const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+		const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+		const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+		const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+		const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+		const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+		const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+		r[0] = _mm_unpacklo_epi64(b0, b4);
+		r[1] = _mm_unpackhi_epi64(b0, b4);
+		r[2] = _mm_unpacklo_epi64(b1, b5);
+		r[3] = _mm_unpackhi_epi64(b1, b5);
+		r[4] = _mm_unpacklo_epi64(b2, b6);
+		r[5] = _mm_unpackhi_epi64(b2, b6);
+		r[6] = _mm_unpacklo_epi64(b3, b7);
+		r[7] = _mm_unpackhi_epi64(b3, b7);
+	}
+
+	/*
+	 * 16 bit: a frame is never more than 8 samples so each one is
+	 * loaded as a row of an 8x8 matrix, after the transpose each row
+	 * holds 8 frames of one channel. stereo has its own quicker path.
+	 */
+	static unsigned int Deinterleave16SSE2(
+		const short *src,
+		const unsigned int frames,
+		const unsigned int channels,
+		char **dst)
+	{
+		unsigned int frame = 0;
+
+		if ( channels == 2 )
+		{
+			for ( ; frame + 8 <= frames ; frame += 8 )
+			{
+				const __m128i a = _mm_loadu_si128((const __m128i*)(src + (frame * 2)));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(src + (frame * 2) + 8));
+
+				// left is the low half of each 32 bit pair, right the high half
+				const __m128i left = _mm_packs_epi32(
+					_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+					_mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+				const __m128i right = _mm_packs_epi32(
+					_mm_srai_epi32(a, 16),
+					_mm_srai_epi32(b, 16));
+
+				_mm_storeu_si128((__m128i*)(((short*)dst[0]) + frame), left);
+				_mm_storeu_si128((__m128i*)(((short*)dst[1]) + frame), right);
+			}
+			return frame;
+		}
+
+		const unsigned int samples = frames * channels;
+		__m128i rows[8];
+
+		// the last row loaded reads 8 samples from the start of its frame
+		for ( ; ((frame + 7) * channels) + 8 <= samples ; frame += 8 )
+		{
+			const short *in = src + (frame * channels);
+
+			for ( unsigned int row = 0 ; row < 8 ; row++ )
+			{
+				rows[row] = _mm_loadu_si128((const __m128i*)(in + (row * channels)));
+			}
+
+			Transpose8x8Epi16(rows);
+
+			for ( unsigned int c = 0 ; c < channels ; c++ )
+			{
+				_mm_storeu_si128((__m128i*)(((short*)dst[c]) + frame), rows[c]);
+			}
+		}
+
+		return frame;
+	}
+
+	/*
+	 * 8 bit: 16 frames are loaded 8 bytes at a time and paired up so
+	 * they can go through the same 16 bit transpose, each 16 bit value
+	 * coming out holds two frames of the same channel
+	 */
+	static unsigned int Deinterleave8SSE2(
+		const unsigned char *src,
+		const unsigned int frames,
+		const unsigned int channels,
+		char **dst)
+	{
+		unsigned int frame = 0;
+
+		if ( channels == 2 )
+		{
+			const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+
+			for ( ; frame + 16 <= frames ; frame += 16 )
+			{
+				const __m128i a = _mm_loadu_si128((const __m128i*)(src + (frame * 2)));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(src + (frame * 2) + 16));
+
+				const __m128i left = _mm_packus_epi16(
+					_mm_and_si128(a, low_bytes),
+					_mm_and_si128(b, low_bytes));
+				const __m128i right = _mm_packus_epi16(
+					_mm_srli_epi16(a, 8),
+					_mm_srli_epi16(b, 8));
+
+				_mm_storeu_si128((__m128i*)(dst[0] + frame), left);
+				_mm_storeu_si128((__m128i*)(dst[1] + frame), right);
+			}
+			return frame;
+		}
+
+		const unsigned int samples = frames * channels;
+		__m128i rows[8];
+
+		for ( ; ((frame + 15) * channels) + 8 <= samples ; frame += 16 )
+		{
+			const unsigned char *in = src + (frame * channels);
+
+			for ( unsigned int row = 0 ; row < 8 ; row++ )
+			{
+				rows[row] = _mm_unpacklo_epi8(
+					_mm_loadl_epi64((const __m128i*)(in + ((row * 2) * channels))),
+					_mm_loadl_epi64((const __m128i*)(in + (((row * 2) + 1) * channels))));
+			}
+
+			Transpose8x8Epi16(rows);
+
+			for ( unsigned int c = 0 ; c < channels ; c++ )
+			{
+				_mm_storeu_si128((__m128i*)(dst[c] + frame), rows[c]);
+			}
+		}
+
+		return frame;
+	}
+
+	/*
+	 * mono to quad, every sample is unpacked against itself twice
+	 */
+	static unsigned int ExpandMono16SSE2(const short *src, const unsigned int count, short *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			const __m128i a = _mm_unpacklo_epi16(v, v);
+			const __m128i b = _mm_unpackhi_epi16(v, v);
+
+			__m128i *out = (__m128i*)(dst + (i * 4));
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi32(a, a));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi32(a, a));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi32(b, b));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi32(b, b));
+		}
+
+		return i;
+	}
+
+	static unsigned int ExpandMono8SSE2(const unsigned char *src, const unsigned int count, unsigned char *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 16 <= count ; i += 16 )
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			const __m128i a = _mm_unpacklo_epi8(v, v);
+			const __m128i b = _mm_unpackhi_epi8(v, v);
+
+			__m128i *out = (__m128i*)(dst + (i * 4));
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(a, a));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(a, a));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(b, b));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(b, b));
+		}
+
+		return i;
+	}
+
+	/*
+	 * stereo to quad, a whole frame is 32 bits (16 bit audio) or
+	 * 16 bits (8 bit audio) so each frame is unpacked against itself
+	 */
+	static unsigned int ExpandStereo16SSE2(const int *src, const unsigned int count, int *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 4 <= count ; i += 4 )
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+			__m128i *out = (__m128i*)(dst + (i * 2));
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi32(v, v));
+		}
+
+		return i;
+	}
+
+	static unsigned int ExpandStereo8SSE2(const short *src, const unsigned int count, short *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+			__m128i *out = (__m128i*)(dst + (i * 2));
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(v, v));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(v, v));
+		}
+
+		return i;
+	}
+
+	/*
+	 * the samples are widened to 32 bits and mixed as floats, the
+	 * saturating pack does the clamping
+	 */
+	static unsigned int CrossFade16SSE2(
+		short *dst,
+		const short *src,
+		const unsigned int count,
+		const float out_gain,
+		const float in_gain)
+	{
+		const __m128 out_gains = _mm_set1_ps(out_gain);
+		const __m128 in_gains = _mm_set1_ps(in_gain);
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+			const __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+
+			const __m128 a_lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16));
+			const __m128 a_hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16));
+			const __m128 b_lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16));
+			const __m128 b_hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(b, b), 16));
+
+			const __m128 lo = _mm_add_ps(_mm_mul_ps(a_lo, out_gains), _mm_mul_ps(b_lo, in_gains));
+			const __m128 hi = _mm_add_ps(_mm_mul_ps(a_hi, out_gains), _mm_mul_ps(b_hi, in_gains));
+
+			_mm_storeu_si128(
+				(__m128i*)(dst + i),
+				_mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+		}
+
+		return i;
+	}
+
+	static unsigned int CrossFadeFloatSSE2(
+		float *dst,
+		const float *src,
+		const unsigned int count,
+		const float out_gain,
+		const float in_gain)
+	{
+		const __m128 out_gains = _mm_set1_ps(out_gain);
+		const __m128 in_gains = _mm_set1_ps(in_gain);
+		unsigned int i = 0;
+
+		for ( ; i + 4 <= count ; i += 4 )
+		{
+			const __m128 a = _mm_mul_ps(_mm_loadu_ps(dst + i), out_gains);
+			const __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i), in_gains);
+
+			_mm_storeu_ps(dst + i, _mm_add_ps(a, b));
+		}
+
+		return i;
+	}
+
+	static unsigned int ToFloat16SSE2(
+		const short *src,
+		const unsigned int count,
+		float *dst)
+	{
+		const __m128 scale = _mm_set1_ps(FROM_16);
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+
+		return i;
+	}
+
+	// flipping the top bit makes unsigned 8 bit signed around 0
+	static unsigned int ToFloat8SSE2(
+		const unsigned char *src,
+		const unsigned int count,
+		float *dst)
+	{
+		const __m128 scale = _mm_set1_ps(FROM_8);
+		const __m128i flip = _mm_set1_epi8((char)0x80);
+		unsigned int i = 0;
+
+		for ( ; i + 16 <= count ; i += 16 )
+		{
+			const __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), flip);
+			const __m128i words[2] = {
+				_mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8),
+				_mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8) };
+
+			for ( unsigned int w = 0 ; w < 2 ; w++ )
+			{
+				const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(words[w], words[w]), 16);
+				const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(words[w], words[w]), 16);
+
+				_mm_storeu_ps(dst + i + (w * 8), _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+				_mm_storeu_ps(dst + i + (w * 8) + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+			}
+		}
+
+		return i;
+	}
+
+	static unsigned int FromFloat16SSE2(
+		const float *src,
+		const unsigned int count,
+		short *dst)
+	{
+		const __m128 scale = _mm_set1_ps(TO_16);
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+			const __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+		}
+
+		return i;
+	}
+
+	static unsigned int FromFloat8SSE2(
+		const float *src,
+		const unsigned int count,
+		unsigned char *dst)
+	{
+		const __m128 scale = _mm_set1_ps(TO_8);
+		const __m128i flip = _mm_set1_epi8((char)0x80);
+		unsigned int i = 0;
+
+		for ( ; i + 16 <= count ; i += 16 )
+		{
+			const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+			const __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+			const __m128i c = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 8), scale));
+			const __m128i d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 12), scale));
+
+			const __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(bytes, flip));
+		}
+
+		return i;
+	}
+
+	static unsigned int Interleave16x2SSE2(
+		const short *left,
+		const short *right,
+		const unsigned int count,
+		short *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+			const __m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+			_mm_storeu_si128((__m128i*)(dst + (i * 2)), _mm_unpacklo_epi16(l, r));
+			_mm_storeu_si128((__m128i*)(dst + (i * 2) + 8), _mm_unpackhi_epi16(l, r));
+		}
+
+		return i;
+	}
+
+	static unsigned int MixPlanesSSE2(
+		const float **src,
+		const float *gains,
+		const unsigned int inputs,
+		const unsigned int frames,
+		float *dst)
+	{
+		__m128 scale[BUS_MAX_CHANNELS];
+		for ( unsigned int c = 0 ; c < inputs ; c++ )
+		{
+			scale[c] = _mm_set1_ps(gains[c]);
+		}
+
+		unsigned int i = 0;
+
+		for ( ; i + 4 <= frames ; i += 4 )
+		{
+			__m128 sum = _mm_setzero_ps();
+
+			for ( unsigned int c = 0 ; c < inputs ; c++ )
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src[c] + i), scale[c]));
+			}
+
+			_mm_storeu_ps(dst + i, sum);
+		}
+
+		return i;
+	}
+
+	// only for stages at least 4 butterflies wide
+	static void FftStageSSE2(
+		float *re,
+		float *im,
+		const unsigned int size,
+		const unsigned int half,
+		const float *twiddles)
+	{
+		const float *twiddle_re = twiddles + half;
+		const float *twiddle_im = twiddles + size + half;
+
+		for ( unsigned int group = 0 ; group < size ; group += half * 2 )
+		{
+			float *re_a = re + group;
+			float *im_a = im + group;
+			float *re_b = re_a + half;
+			float *im_b = im_a + half;
+
+			for ( unsigned int k = 0 ; k < half ; k += 4 )
+			{
+				const __m128 wr = _mm_loadu_ps(twiddle_re + k);
+				const __m128 wi = _mm_loadu_ps(twiddle_im + k);
+				const __m128 br = _mm_loadu_ps(re_b + k);
+				const __m128 bi = _mm_loadu_ps(im_b + k);
+				const __m128 ar = _mm_loadu_ps(re_a + k);
+				const __m128 ai = _mm_loadu_ps(im_a + k);
+
+				const __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+				const __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+
+				_mm_storeu_ps(re_b + k, _mm_sub_ps(ar, tr));
+				_mm_storeu_ps(im_b + k, _mm_sub_ps(ai, ti));
+				_mm_storeu_ps(re_a + k, _mm_add_ps(ar, tr));
+				_mm_storeu_ps(im_a + k, _mm_add_ps(ai, ti));
+			}
+		}
+	}
+
+	static inline __m128i NextRandomSSE2(__m128i x)
+	{
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+		return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	}
+
+	static inline __m128 DitherNoiseSSE2(const __m128i state)
+	{
+		const __m128 high = _mm_cvtepi32_ps(_mm_srli_epi32(state, 16));
+		const __m128 low = _mm_cvtepi32_ps(_mm_and_si128(state, _mm_set1_epi32(0xFFFF)));
+
+		return _mm_mul_ps(_mm_sub_ps(high, low), _mm_set1_ps(DITHER_SCALE));
+	}
+
+	/*
+	 * there's no SSE2 shuffle that can spread out packed 24 bit
+	 * samples so they're gathered one at a time
+	 */
+	static inline __m128 LoadSamplesSSE2(
+		const char *src,
+		const unsigned int i,
+		const sample_format format)
+	{
+		switch ( format )
+		{
+		case SAMPLE_PCM24:
+			{
+				const unsigned char *p = (const unsigned char*)src + (i * THREE_BYTE_SAMPLE);
+				const __m128i v = _mm_set_epi32(Load24(p + 9), Load24(p + 6), Load24(p + 3), Load24(p));
+				return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(INT32_SCALE));
+			}
+		case SAMPLE_PCM32:
+			{
+				const __m128i v = _mm_loadu_si128((const __m128i*)((const int*)src + i));
+				return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(INT32_SCALE));
+			}
+		default:
+			return _mm_loadu_ps((const float*)src + i);
+		}
+	}
+
+	static unsigned int ConvertToFloatSSE2(
+		const char *src,
+		const unsigned int samples,
+		const sample_format format,
+		float *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 4 <= samples ; i += 4 )
+		{
+			_mm_storeu_ps(dst + i, LoadSamplesSSE2(src, i, format));
+		}
+
+		return i;
+	}
+
+	// two vectors at a time, one for each half of the dither lanes
+	static unsigned int ConvertTo16SSE2(
+		const char *src,
+		const unsigned int samples,
+		const sample_format format,
+		short *dst,
+		unsigned int *dither)
+	{
+		const __m128 scale = _mm_set1_ps(FLOAT_TO_16);
+		__m128i state_low = _mm_loadu_si128((const __m128i*)dither);
+		__m128i state_high = _mm_loadu_si128((const __m128i*)(dither + 4));
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= samples ; i += 8 )
+		{
+			state_low = NextRandomSSE2(state_low);
+			state_high = NextRandomSSE2(state_high);
+
+			const __m128 lo = _mm_add_ps(
+				_mm_mul_ps(LoadSamplesSSE2(src, i, format), scale),
+				DitherNoiseSSE2(state_low));
+			const __m128 hi = _mm_add_ps(
+				_mm_mul_ps(LoadSamplesSSE2(src, i + 4, format), scale),
+				DitherNoiseSSE2(state_high));
+
+			_mm_storeu_si128(
+				(__m128i*)(dst + i),
+				_mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+		}
+
+		_mm_storeu_si128((__m128i*)dither, state_low);
+		_mm_storeu_si128((__m128i*)(dither + 4), state_high);
+
+		return i;
+	}
+
+	// flip the top bit and unpack it under a zero byte
+	static unsigned int Widen8To16SSE2(
+		const unsigned char *src,
+		const unsigned int count,
+		short *dst)
+	{
+		const __m128i flip = _mm_set1_epi8((char)0x80);
+		const __m128i zero = _mm_setzero_si128();
+		unsigned int i = 0;
+
+		for ( ; i + 16 <= count ; i += 16 )
+		{
+			const __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), flip);
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(zero, v));
+			_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(zero, v));
+		}
+
+		return i;
+	}
+
+	/*
+	 * ######################## AVX2 versions
+	 *
+	 * the same as SSE2 but twice as wide. the unpacks only work within
+	 * each 128 bit lane, so the low lane is given the first half of the
+	 * frames and the high lane the second half.
+	 */
+	static inline __m256i Combine128(const __m128i low, const __m128i high)
+	{
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+	}
+
+	static inline void Transpose8x8Epi16x2(__m256i *r)
+	{
+		const __m256i a0 = _mm256_unpacklo_epi16(r[0], r[1]);
+		const __m256i a1 = _mm256_unpackhi_epi16(r[0], r[1]);
+		const __m256i a2 = _mm256_unpacklo_epi16(r[2], r[3]);
+		const __m256i a3 = _mm256_unpackhi_epi16(r[2], r[3]);
+		const __m256i a4 = _mm256_unpacklo_epi16(r[4], r[5]);
+		const __m256i a5 = _mm256_unpackhi_epi16(r[4], r[5]);
+		const __m256i a6 = _mm256_unpacklo_epi16(r[6], r[7]);
+		const __m256i a7 = _mm256_unpackhi_epi16(r[6], r[7]);
+
+		const __m256i b0 = _mm256_unpacklo_epi32(a0, a2);
+		const __m256i b1 = _mm256_unpackhi_epi32(a0, a2);
+		const __m256i b2 = _mm256_unpacklo_epi32(a1, a3);
+		const __m256i b3 = _mm256_unpackhi_epi32(a1, a3);
+		const __m256i b4 = _mm256_unpacklo_epi32(a4, a6);
+		const __m256i b5 = _mm256_unpackhi_epi32(a4, a6);
+		const __m256i b6 = _mm256_unpacklo_epi32(a5, a7);
+		const __m256i b7 = _mm256_unpackhi_epi32(a5, a7);
+
+		r[0] = _mm256_unpacklo_epi64(b0, b4);
+		r[1] = _mm256_unpackhi_epi64(b0, b4);
+		r[2] = _mm256_unpacklo_epi64(b1, b5);
+		r[3] = _mm256_unpackhi_epi64(b1, b5);
+		r[4] = _mm256_unpacklo_epi64(b2, b6);
+		r[5] = _mm256_unpackhi_epi64(b2, b6);
+		r[6] = _mm256_unpacklo_epi64(b3, b7);
+		r[7] = _mm256_unpackhi_epi64(b3, b7);
+	}
+
+	static unsigned int Deinterleave16AVX2(
+		const short *src,
+		const unsigned int frames,
+		const unsigned int channels,
+		char **dst)
+	{
+		unsigned int frame = 0;
+
+		if ( channels == 2 )
+		{
+			for ( ; frame + 16 <= frames ; frame += 16 )
+			{
+				const __m256i a = _mm256_loadu_si256((const __m256i*)(src + (frame * 2)));
+				const __m256i b = _mm256_loadu_si256((const __m256i*)(src + (frame * 2) + 16));
+
+				// the packs interleave the lanes, the permute puts them back in order
+				const __m256i left = _mm256_permute4x64_epi64(
+					_mm256_packs_epi32(
+						_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+						_mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16)),
+					0xD8);
+				const __m256i right = _mm256_permute4x64_epi64(
+					_mm256_packs_epi32(
+						_mm256_srai_epi32(a, 16),
+						_mm256_srai_epi32(b, 16)),
+					0xD8);
+
+				_mm256_storeu_si256((__m256i*)(((short*)dst[0]) + frame), left);
+				_mm256_storeu_si256((__m256i*)(((short*)dst[1]) + frame), right);
+			}
+			return frame;
+		}
+
+		const unsigned int samples = frames * channels;
+		__m256i rows[8];
+
+		for ( ; ((frame + 15) * channels) + 8 <= samples ; frame += 16 )
+		{
+			const short *in = src + (frame * channels);
+
+			for ( unsigned int row = 0 ; row < 8 ; row++ )
+			{
+				rows[row] = Combine128(
+					_mm_loadu_si128((const __m128i*)(in + (row * channels))),
+					_mm_loadu_si128((const __m128i*)(in + ((row + 8) * channels))));
+			}
+
+			Transpose8x8Epi16x2(rows);
+
+			for ( unsigned int c = 0 ; c < channels ; c++ )
+			{
+				_mm256_storeu_si256((__m256i*)(((short*)dst[c]) + frame), rows[c]);
+			}
+		}
+
+		return frame;
+	}
+
+	static unsigned int Deinterleave8AVX2(
+		const unsigned char *src,
+		const unsigned int frames,
+		const unsigned int channels,
+		char **dst)
+	{
+		unsigned int frame = 0;
+
+		if ( channels == 2 )
+		{
+			const __m256i low_bytes = _mm256_set1_epi16(0x00FF);
+
+			for ( ; frame + 32 <= frames ; frame += 32 )
+			{
+				const __m256i a = _mm256_loadu_si256((const __m256i*)(src + (frame * 2)));
+				const __m256i b = _mm256_loadu_si256((const __m256i*)(src + (frame * 2) + 32));
+
+				const __m256i left = _mm256_permute4x64_epi64(
+					_mm256_packus_epi16(
+						_mm256_and_si256(a, low_bytes),
+						_mm256_and_si256(b, low_bytes)),
+					0xD8);
+				const __m256i right = _mm256_permute4x64_epi64(
+					_mm256_packus_epi16(
+						_mm256_srli_epi16(a, 8),
+						_mm256_srli_epi16(b, 8)),
+					0xD8);
+
+				_mm256_storeu_si256((__m256i*)(dst[0] + frame), left);
+				_mm256_storeu_si256((__m256i*)(dst[1] + frame), right);
+			}
+			return frame;
+		}
+
+		const unsigned int samples = frames * channels;
+		__m256i rows[8];
+
+		for ( ; ((frame + 31) * channels) + 8 <= samples ; frame += 32 )
+		{
+			const unsigned char *in = src + (frame * channels);
+
+			for ( unsigned int row = 0 ; row < 8 ; row++ )
+			{
+				const unsigned char *even = in + ((row * 2) * channels);
+				const unsigned char *odd = in + (((row * 2) + 1) * channels);
+
+				rows[row] = _mm256_unpacklo_epi8(
+					Combine128(
+						_mm_loadl_epi64((const __m128i*)even),
+						_mm_loadl_epi64((const __m128i*)(even + (16 * channels)))),
+					Combine128(
+						_mm_loadl_epi64((const __m128i*)odd),
+						_mm_loadl_epi64((const __m128i*)(odd + (16 * channels)))));
+			}
+
+			Transpose8x8Epi16x2(rows);
+
+			for ( unsigned int c = 0 ; c < channels ; c++ )
+			{
+				_mm256_storeu_si256((__m256i*)(dst[c] + frame), rows[c]);
+			}
+		}
+
+		return frame;
+	}
+
+	/*
+	 * the 256 bit unpacks leave the first half of the output in the
+	 * low lanes and the second half in the high lanes, the lane
+	 * permutes put them back in order
+	 */
+	static unsigned int ExpandMono16AVX2(const short *src, const unsigned int count, short *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 16 <= count ; i += 16 )
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+			const __m256i a = _mm256_unpacklo_epi16(v, v);
+			const __m256i b = _mm256_unpackhi_epi16(v, v);
+			const __m256i a_lo = _mm256_unpacklo_epi32(a, a);
+			const __m256i a_hi = _mm256_unpackhi_epi32(a, a);
+			const __m256i b_lo = _mm256_unpacklo_epi32(b, b);
+			const __m256i b_hi = _mm256_unpackhi_epi32(b, b);
+
+			__m256i *out = (__m256i*)(dst + (i * 4));
+			_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(a_lo, a_hi, 0x20));
+			_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(b_lo, b_hi, 0x20));
+			_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(a_lo, a_hi, 0x31));
+			_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(b_lo, b_hi, 0x31));
+		}
+
+		return i;
+	}
+
+	static unsigned int ExpandMono8AVX2(const unsigned char *src, const unsigned int count, unsigned char *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 32 <= count ; i += 32 )
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+			const __m256i a = _mm256_unpacklo_epi8(v, v);
+			const __m256i b = _mm256_unpackhi_epi8(v, v);
+			const __m256i a_lo = _mm256_unpacklo_epi16(a, a);
+			const __m256i a_hi = _mm256_unpackhi_epi16(a, a);
+			const __m256i b_lo = _mm256_unpacklo_epi16(b, b);
+			const __m256i b_hi = _mm256_unpackhi_epi16(b, b);
+
+			__m256i *out = (__m256i*)(dst + (i * 4));
+			_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(a_lo, a_hi, 0x20));
+			_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(b_lo, b_hi, 0x20));
+			_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(a_lo, a_hi, 0x31));
+			_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(b_lo, b_hi, 0x31));
+		}
+
+		return i;
+	}
+
+	static unsigned int ExpandStereo16AVX2(const int *src, const unsigned int count, int *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= count ; i += 8 )
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+			const __m256i a = _mm256_unpacklo_epi32(v, v);
+			const __m256i b = _mm256_unpackhi_epi32(v, v);
+
+			__m256i *out = (__m256i*)(dst + (i * 2));
+			_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(a, b, 0x20));
+			_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(a, b, 0x31));
+		}
+
+		return i;
+	}
+
+	static unsigned int ExpandStereo8AVX2(const short *src, const unsigned int count, short *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 16 <= count ; i += 16 )
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+			const __m256i a = _mm256_unpacklo_epi16(v, v);
+			const __m256i b = _mm256_unpackhi_epi16(v, v);
+
+			__m256i *out = (__m256i*)(dst + (i * 2));
+			_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(a, b, 0x20));
+			_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(a, b, 0x31));
+		}
+
+		return i;
+	}
+
+	static inline __m256i NextRandomAVX2(__m256i x)
+	{
+		x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+		return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+	}
+
+	static inline __m256 DitherNoiseAVX2(const __m256i state)
+	{
+		const __m256 high = _mm256_cvtepi32_ps(_mm256_srli_epi32(state, 16));
+		const __m256 low = _mm256_cvtepi32_ps(_mm256_and_si256(state, _mm256_set1_epi32(0xFFFF)));
+
+		return _mm256_mul_ps(_mm256_sub_ps(high, low), _mm256_set1_ps(DITHER_SCALE));
+	}
+
+	static inline __m256 LoadSamplesAVX2(
+		const char *src,
+		const unsigned int i,
+		const sample_format format)
+	{
+		switch ( format )
+		{
+		case SAMPLE_PCM24:
+			{
+				const unsigned char *p = (const unsigned char*)src + (i * THREE_BYTE_SAMPLE);
+				const __m256i v = _mm256_set_epi32(
+					Load24(p + 21), Load24(p + 18), Load24(p + 15), Load24(p + 12),
+					Load24(p + 9), Load24(p + 6), Load24(p + 3), Load24(p));
+				return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(INT32_SCALE));
+			}
+		case SAMPLE_PCM32:
+			{
+				const __m256i v = _mm256_loadu_si256((const __m256i*)((const int*)src + i));
+				return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(INT32_SCALE));
+			}
+		default:
+			return _mm256_loadu_ps((const float*)src + i);
+		}
+	}
+
+	static unsigned int ConvertToFloatAVX2(
+		const char *src,
+		const unsigned int samples,
+		const sample_format format,
+		float *dst)
+	{
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= samples ; i += 8 )
+		{
+			_mm256_storeu_ps(dst + i, LoadSamplesAVX2(src, i, format));
+		}
+
+		return i;
+	}
+
+	// one vector covers every dither lane
+	static unsigned int ConvertTo16AVX2(
+		const char *src,
+		const unsigned int samples,
+		const sample_format format,
+		short *dst,
+		unsigned int *dither)
+	{
+		const __m256 scale = _mm256_set1_ps(FLOAT_TO_16);
+		__m256i state = _mm256_loadu_si256((const __m256i*)dither);
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= samples ; i += 8 )
+		{
+			state = NextRandomAVX2(state);
+
+			const __m256i v = _mm256_cvtps_epi32(_mm256_add_ps(
+				_mm256_mul_ps(LoadSamplesAVX2(src, i, format), scale),
+				DitherNoiseAVX2(state)));
+
+			_mm_storeu_si128(
+				(__m128i*)(dst + i),
+				_mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+		}
+
+		_mm256_storeu_si256((__m256i*)dither, state);
+
+		return i;
+	}
+
+	static unsigned int Widen8To16AVX2(
+		const unsigned char *src,
+		const unsigned int count,
+		short *dst)
+	{
+		const __m128i flip = _mm_set1_epi8((char)0x80);
+		unsigned int i = 0;
+
+		for ( ; i + 32 <= count ; i += 32 )
+		{
+			const __m128i lo = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), flip);
+			const __m128i hi = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i + 16)), flip);
+
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_slli_epi16(_mm256_cvtepi8_epi16(lo), 8));
+			_mm256_storeu_si256((__m256i*)(dst + i + 16), _mm256_slli_epi16(_mm256_cvtepi8_epi16(hi), 8));
+		}
+
+		return i;
+	}
+
+	static unsigned int MixPlanesAVX2(
+		const float **src,
+		const float *gains,
+		const unsigned int inputs,
+		const unsigned int frames,
+		float *dst)
+	{
+		__m256 scale[BUS_MAX_CHANNELS];
+		for ( unsigned int c = 0 ; c < inputs ; c++ )
+		{
+			scale[c] = _mm256_set1_ps(gains[c]);
+		}
+
+		unsigned int i = 0;
+
+		for ( ; i + 8 <= frames ; i += 8 )
+		{
+			__m256 sum = _mm256_setzero_ps();
+
+			for ( unsigned int c = 0 ; c < inputs ; c++ )
+			{
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(src[c] + i), scale[c]));
+			}
+
+			_mm256_storeu_ps(dst + i, sum);
+		}
+
+		return i;
+	}
+
+	/*
+		deinterleave
+
+		split (frames) of interleaved audio out to one buffer per
+		channel. anything the vector versions can't do a whole vector
+		of is finished off by the scalar version.
+	*/
+	void Output_Dsp::Deinterleave(
+		const char *src,
+		const unsigned int frames,
+		const unsigned int channels,
+		const unsigned int sample_size,
+		char **dst)
+	{
+		if ( channels == 1 )
+		{
+			memcpy_s(dst[0], frames * sample_size, src, frames * sample_size);
+			return;
+		}
+
+		unsigned int done = 0;
+
+		if ( sample_size == TWO_BYTE_SAMPLE )
+		{
+			if ( level == DSP_AVX2 )
+			{
+				done = Deinterleave16AVX2((const short*)src, frames, channels, dst);
+			}
+			else if ( level == DSP_SSE2 )
+			{
+				done = Deinterleave16SSE2((const short*)src, frames, channels, dst);
+			}
+
+			DeinterleaveScalar<short>((const short*)src, done, frames, channels, dst);
+		}
+		else if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			// float audio, there's too little of it to be worth a vector version
+			DeinterleaveScalar<int>((const int*)src, 0, frames, channels, dst);
+		}
+		else
+		{
+			if ( level == DSP_AVX2 )
+			{
+				done = Deinterleave8AVX2((const unsigned char*)src, frames, channels, dst);
+			}
+			else if ( level == DSP_SSE2 )
+			{
+				done = Deinterleave8SSE2((const unsigned char*)src, frames, channels, dst);
+			}
+
+			DeinterleaveScalar<unsigned char>((const unsigned char*)src, done, frames, channels, dst);
+		}
+	}
+
+	/*
+		expand mono to quad
+	*/
+	void Output_Dsp::ExpandMonoToQuad(
+		const char *src,
+		const unsigned int frames,
+		const unsigned int sample_size,
+		char *dst)
+	{
+		unsigned int done = 0;
+
+		if ( sample_size == TWO_BYTE_SAMPLE )
+		{
+			if ( level == DSP_AVX2 )
+			{
+				done = ExpandMono16AVX2((const short*)src, frames, (short*)dst);
+			}
+			else if ( level == DSP_SSE2 )
+			{
+				done = ExpandMono16SSE2((const short*)src, frames, (short*)dst);
+			}
+
+			DuplicateScalar<short, 4>((const short*)src, done, frames, (short*)dst);
+		}
+		else if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			DuplicateScalar<int, 4>((const int*)src, 0, frames, (int*)dst);
+		}
+		else
+		{
+			if ( level == DSP_AVX2 )
+			{
+				done = ExpandMono8AVX2((const unsigned char*)src, frames, (unsigned char*)dst);
+			}
+			else if ( level == DSP_SSE2 )
+			{
+				done = ExpandMono8SSE2((const unsigned char*)src, frames, (unsigned char*)dst);
+			}
+
+			DuplicateScalar<unsigned char, 4>((const unsigned char*)src, done, frames, (unsigned char*)dst);
+		}
+	}
+
+	/*
+		expand stereo to quad
+	*/
+	void Output_Dsp::ExpandStereoToQuad(
+		const char *src,
+		const unsigned int frames,
+		const unsigned int sample_size,
+		char *dst)
+	{
+		unsigned int done = 0;
+
+		if ( sample_size == TWO_BYTE_SAMPLE )
+		{
+			if ( level == DSP_AVX2 )
+			{
+				done = ExpandStereo16AVX2((const int*)src, frames, (int*)dst);
+			}
+			else if ( level == DSP_SSE2 )
+			{
+				done = ExpandStereo16SSE2((const int*)src, frames, (int*)dst);
+			}
+
+			DuplicateScalar<int, 2>((const int*)src, done, frames, (int*)dst);
+		}
+		else if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			DuplicateScalar<__int64, 2>((const __int64*)src, 0, frames, (__int64*)dst);
+		}
+		else
+		{
+			if ( level == DSP_AVX2 )
+			{
+				done = ExpandStereo8AVX2((const short*)src, frames, (short*)dst);
+			}
+			else if ( level == DSP_SSE2 )
+			{
+				done = ExpandStereo8SSE2((const short*)src, frames, (short*)dst);
+			}
+
+			DuplicateScalar<short, 2>((const short*)src, done, frames, (short*)dst);
+		}
+	}
+
+	/*
+		crossfade
+
+		the gains are worked out every FADE_STEP_FRAMES, counted
+		from the start of the fade so they don't depend on how the
+		audio was split up. within a step every sample has the same
+		gains so the vector version works straight across frames.
+		the AVX2 level uses the SSE2 version, it's memory bound
+	*/
+	void Output_Dsp::CrossFade(
+		char *dst,
+		const char *src,
+		const unsigned int frames,
+		const unsigned int channels,
+		const unsigned int sample_size,
+		const unsigned int position,
+		const unsigned int length)
+	{
+		unsigned int frame = 0;
+
+		while ( frame < frames )
+		{
+			const unsigned int at = position + frame;
+			unsigned int step = FADE_STEP_FRAMES - (at % FADE_STEP_FRAMES);
+			if ( step > frames - frame )
+			{
+				step = frames - frame;
+			}
+
+			const unsigned int step_start = at - (at % FADE_STEP_FRAMES);
+			const double angle = (length == 0 || step_start >= length) ? 
+				HALF_PI : (HALF_PI * step_start) / length;
+
+			const float out_gain = (float)cos(angle);
+			const float in_gain = (float)sin(angle);
+
+			const unsigned int offset = frame * channels;
+			const unsigned int count = step * channels;
+
+			if ( sample_size == TWO_BYTE_SAMPLE )
+			{
+				short *out = ((short*)dst) + offset;
+				const short *in = ((const short*)src) + offset;
+				unsigned int done = 0;
+
+				if ( level >= DSP_SSE2 )
+				{
+					done = CrossFade16SSE2(out, in, count, out_gain, in_gain);
+				}
+
+				CrossFade16Scalar(out, in, done, count, out_gain, in_gain);
+			}
+			else if ( sample_size == FOUR_BYTE_SAMPLE )
+			{
+				float *out = ((float*)dst) + offset;
+				const float *in = ((const float*)src) + offset;
+				unsigned int done = 0;
+
+				if ( level >= DSP_SSE2 )
+				{
+					done = CrossFadeFloatSSE2(out, in, count, out_gain, in_gain);
+				}
+
+				CrossFadeFloatScalar(out, in, done, count, out_gain, in_gain);
+			}
+			else
+			{
+				CrossFade8Scalar(
+					((unsigned char*)dst) + offset,
+					((const unsigned char*)src) + offset,
+					count,
+					out_gain,
+					in_gain);
+			}
+
+			frame += step;
+		}
+	}
+
+	/*
+		to float
+
+		the AVX2 level uses the SSE2 versions for the bus, the blocks
+		are small enough that they're bound by the loads and stores
+	*/
+	void Output_Dsp::ToFloat(
+		const char *src,
+		const unsigned int samples,
+		const unsigned int sample_size,
+		float *dst)
+	{
+		if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			memcpy_s(dst, samples * FOUR_BYTE_SAMPLE, src, samples * FOUR_BYTE_SAMPLE);
+			return;
+		}
+
+		unsigned int done = 0;
+
+		if ( level >= DSP_SSE2 )
+		{
+			if ( sample_size == TWO_BYTE_SAMPLE )
+			{
+				done = ToFloat16SSE2((const short*)src, samples, dst);
+			}
+			else
+			{
+				done = ToFloat8SSE2((const unsigned char*)src, samples, dst);
+			}
+		}
+
+		ToFloatScalar(src, done, samples, sample_size, dst);
+	}
+
+	/*
+		from float
+	*/
+	void Output_Dsp::FromFloat(
+		const float *src,
+		const unsigned int samples,
+		const unsigned int sample_size,
+		char *dst)
+	{
+		if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			memcpy_s(dst, samples * FOUR_BYTE_SAMPLE, src, samples * FOUR_BYTE_SAMPLE);
+			return;
+		}
+
+		unsigned int done = 0;
+
+		if ( level >= DSP_SSE2 )
+		{
+			if ( sample_size == TWO_BYTE_SAMPLE )
+			{
+				done = FromFloat16SSE2(src, samples, (short*)dst);
+			}
+			else
+			{
+				done = FromFloat8SSE2(src, samples, (unsigned char*)dst);
+			}
+		}
+
+		FromFloatScalar(src, done, samples, sample_size, dst);
+	}
+
+	/*
+		interleave
+
+		only 16 bit stereo, by far the most common, has a vector
+		version
+	*/
+	void Output_Dsp::Interleave(
+		const char **src,
+		const unsigned int frames,
+		const unsigned int channels,
+		const unsigned int sample_size,
+		char *dst)
+	{
+		if ( channels == 1 )
+		{
+			memcpy_s(dst, frames * sample_size, src[0], frames * sample_size);
+			return;
+		}
+
+		unsigned int done = 0;
+
+		if ( sample_size == TWO_BYTE_SAMPLE )
+		{
+			if ( channels == 2 && level >= DSP_SSE2 )
+			{
+				done = Interleave16x2SSE2(
+					(const short*)src[0],
+					(const short*)src[1],
+					frames,
+					(short*)dst);
+			}
+
+			InterleaveScalar<short>(src, done, frames, channels, dst);
+		}
+		else if ( sample_size == FOUR_BYTE_SAMPLE )
+		{
+			InterleaveScalar<int>(src, 0, frames, channels, dst);
+		}
+		else
+		{
+			InterleaveScalar<unsigned char>(src, 0, frames, channels, dst);
+		}
+	}
+
+	/*
+		mix planes
+
+		inputs with no gain are left out before mixing, so a sparse
+		matrix row only reads the planes it uses
+	*/
+	void Output_Dsp::MixPlanes(
+		const float **src,
+		const float *gains,
+		const unsigned int inputs,
+		const unsigned int frames,
+		float *dst)
+	{
+		const float *used[BUS_MAX_CHANNELS];
+		float used_gains[BUS_MAX_CHANNELS];
+		unsigned int count = 0;
+
+		for ( unsigned int c = 0 ; c < inputs && count < BUS_MAX_CHANNELS ; c++ )
+		{
+			if ( gains[c] != 0.0f )
+			{
+				used[count] = src[c];
+				used_gains[count] = gains[c];
+				count++;
+			}
+		}
+
+		if ( count == 0 )
+		{
+			memset(dst, 0, frames * FOUR_BYTE_SAMPLE);
+			return;
+		}
+
+		unsigned int done = 0;
+
+		if ( level == DSP_AVX2 )
+		{
+			done = MixPlanesAVX2(used, used_gains, count, frames, dst);
+		}
+		else if ( level == DSP_SSE2 )
+		{
+			done = MixPlanesSSE2(used, used_gains, count, frames, dst);
+		}
+
+		MixPlanesScalar(used, used_gains, count, done, frames, dst);
+	}
+
+	/*
+		setup fft
+
+		the twiddles of each stage one after another, stage (half)
+		starts at (half), real parts then imaginary parts
+	*/
+	void Output_Dsp::SetupFft(const unsigned int size, float *twiddles)
+	{
+		for ( unsigned int half = 1 ; half < size ; half *= 2 )
+		{
+			for ( unsigned int k = 0 ; k < half ; k++ )
+			{
+				const double angle = (-HALF_PI * 2.0 * k) / half;
+
+				twiddles[half + k] = (float)cos(angle);
+				twiddles[size + half + k] = (float)sin(angle);
+			}
+		}
+
+		twiddles[0] = 0.0f;
+		twiddles[size] = 0.0f;
+	}
+
+	/*
+		fft
+
+		radix 2, the input is put in bit reversed order and then
+		combined a stage at a time. the AVX2 level uses the SSE2
+		stages, the frames are too small to gain from anything wider
+	*/
+	void Output_Dsp::Fft(
+		float *re,
+		float *im,
+		const unsigned int size,
+		const float *twiddles)
+	{
+		for ( unsigned int i = 1, j = 0 ; i < size ; i++ )
+		{
+			unsigned int bit = size >> 1;
+			for ( ; j & bit ; bit >>= 1 )
+			{
+				j ^= bit;
+			}
+			j ^= bit;
+
+			if ( i < j )
+			{
+				const float swap_re = re[i];
+				const float swap_im = im[i];
+				re[i] = re[j];
+				im[i] = im[j];
+				re[j] = swap_re;
+				im[j] = swap_im;
+			}
+		}
+
+		for ( unsigned int half = 1 ; half < size ; half *= 2 )
+		{
+			if ( level >= DSP_SSE2 && half >= 4 )
+			{
+				FftStageSSE2(re, im, size, half, twiddles);
+			}
+			else
+			{
+				FftStageScalar(re, im, size, half, twiddles);
+			}
+		}
+	}
+
+	/*
+		convert to float
+	*/
+	void Output_Dsp::ConvertToFloat(
+		const char *src,
+		const unsigned int samples,
+		const sample_format format,
+		float *dst)
+	{
+		if ( format == SAMPLE_FLOAT32 )
+		{
+			memcpy_s(dst, samples * FOUR_BYTE_SAMPLE, src, samples * FOUR_BYTE_SAMPLE);
+			return;
+		}
+
+		unsigned int done = 0;
+
+		if ( level == DSP_AVX2 )
+		{
+			done = ConvertToFloatAVX2(src, samples, format, dst);
+		}
+		else if ( level == DSP_SSE2 )
+		{
+			done = ConvertToFloatSSE2(src, samples, format, dst);
+		}
+
+		ConvertToFloatScalar(src, done, samples, format, dst);
+	}
+
+	/*
+		convert to 16
+
+		the noise is added before rounding, so the rounding error
+		doesn't follow the signal
+	*/
+	void Output_Dsp::ConvertTo16(
+		const char *src,
+		const unsigned int samples,
+		const sample_format format,
+		short *dst,
+		unsigned int *dither)
+	{
+		unsigned int done = 0;
+
+		if ( level == DSP_AVX2 )
+		{
+			done = ConvertTo16AVX2(src, samples, format, dst, dither);
+		}
+		else if ( level == DSP_SSE2 )
+		{
+			done = ConvertTo16SSE2(src, samples, format, dst, dither);
+		}
+
+		ConvertTo16Scalar(src, done, samples, format, dst, dither);
+	}
+
+	void Output_Dsp::Widen8To16(
+		const unsigned char *src,
+		const unsigned int samples,
+		short *dst)
+	{
+		unsigned int done = 0;
+
+		if ( level == DSP_AVX2 )
+		{
+			done = Widen8To16AVX2(src, samples, dst);
+		}
+		else if ( level == DSP_SSE2 )
+		{
+			done = Widen8To16SSE2(src, samples, dst);
+		}
+
+		Widen8To16Scalar(src, done, samples, dst);
+	}
+
+	void Output_Dsp::SeedDither(unsigned int *dither)
+	{
+		// an odd number times anything but 0 is never 0
+		for ( unsigned int lane = 0 ; lane < DITHER_LANES ; lane++ )
+		{
+			dither[lane] = 0x9E3779B9u * (lane + 1);
+		}
+	}
+
+	unsigned int Output_Dsp::GetSampleSize(const sample_format format)
+	{
+		return format == SAMPLE_PCM24 ? THREE_BYTE_SAMPLE : FOUR_BYTE_SAMPLE;
+	}
+
+	/*
+		measure conversion
+
+		convert the same block over and over, the input is a quiet
+		ramp so floats aren't anything unusual
+	*/
+	double Output_Dsp::MeasureConversion(
+		const sample_format format,
+		const bool to_float)
+	{
+		static int input[MEASURE_SAMPLES];
+		static float output[MEASURE_SAMPLES];
+
+		unsigned int dither[DITHER_LANES];
+		SeedDither(dither);
+
+		for ( unsigned int i = 0 ; i < MEASURE_SAMPLES ; i++ )
+		{
+			const int value = (int)(i % 2048) - 1024;
+
+			if ( format == SAMPLE_FLOAT32 )
+			{
+				((float*)input)[i] = (float)value / 2048.0f;
+			}
+			else
+			{
+				input[i] = value << 16;
+			}
+		}
+
+		LARGE_INTEGER frequency;
+		LARGE_INTEGER start;
+		LARGE_INTEGER end;
+
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&start);
+
+		for ( unsigned int pass = 0 ; pass < MEASURE_PASSES ; pass++ )
+		{
+			if ( to_float )
+			{
+				ConvertToFloat((const char*)input, MEASURE_SAMPLES, format, output);
+			}
+			else
+			{
+				ConvertTo16((const char*)input, MEASURE_SAMPLES, format, (short*)output, dither);
+			}
+		}
+
+		QueryPerformanceCounter(&end);
+
+		const double seconds = 
+			(double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+
+		if ( seconds <= 0.0 )
+		{
+			return 0.0;
+		}
+
+		return ((double)MEASURE_SAMPLES * MEASURE_PASSES) / (seconds * 1000000.0);
+	}
+
+	/*
+		self test
+
+		the scalar versions are the reference, every level the cpu
+		supports has to produce exactly the same output
+	*/
+	bool Output_Dsp::SelfTest()
+	{
+		static char input[SELF_TEST_MAX_SIZE];
+		static char expected[SELF_TEST_CHANNELS][SELF_TEST_MAX_SIZE];
+		static char actual[SELF_TEST_CHANNELS][SELF_TEST_MAX_SIZE];
+
+		char *expected_ptrs[SELF_TEST_CHANNELS];
+		char *actual_ptrs[SELF_TEST_CHANNELS];
+
+		for ( unsigned int i = 0 ; i < SELF_TEST_MAX_SIZE ; i++ )
+		{
+			input[i] = (char)((i * 7) + (i >> 3));
+		}
+
+		for ( unsigned int c = 0 ; c < SELF_TEST_CHANNELS ; c++ )
+		{
+			expected_ptrs[c] = expected[c];
+			actual_ptrs[c] = actual[c];
+		}
+
+		const dsp_level current = level;
+		bool ok = true;
+
+		for ( int test_level = DSP_SSE2 ; test_level <= supported ; test_level++ )
+		{
+			for ( unsigned int sample_size = ONE_BYTE_SAMPLE ;
+				sample_size <= TWO_BYTE_SAMPLE ;
+				sample_size++ )
+			{
+				const unsigned int frames = SELF_TEST_FRAMES;
+
+				for ( unsigned int channels = 1 ; channels <= SELF_TEST_CHANNELS ; channels++ )
+				{
+					level = DSP_SCALAR;
+					Deinterleave(input, frames, channels, sample_size, expected_ptrs);
+					level = (dsp_level)test_level;
+					Deinterleave(input, frames, channels, sample_size, actual_ptrs);
+
+					for ( unsigned int c = 0 ; c < channels ; c++ )
+					{
+						ok &= memcmp(expected[c], actual[c], frames * sample_size) == 0;
+					}
+				}
+
+				level = DSP_SCALAR;
+				ExpandMonoToQuad(input, frames, sample_size, expected[0]);
+				level = (dsp_level)test_level;
+				ExpandMonoToQuad(input, frames, sample_size, actual[0]);
+				ok &= memcmp(expected[0], actual[0], frames * sample_size * 4) == 0;
+
+				level = DSP_SCALAR;
+				ExpandStereoToQuad(input, frames, sample_size, expected[0]);
+				level = (dsp_level)test_level;
+				ExpandStereoToQuad(input, frames, sample_size, actual[0]);
+				ok &= memcmp(expected[0], actual[0], frames * sample_size * 4) == 0;
+
+				// fade the input against itself reversed, part way in
+				const unsigned int fade_size = frames * 2 * sample_size;
+				memcpy_s(expected[0], SELF_TEST_MAX_SIZE, input, fade_size);
+				memcpy_s(actual[0], SELF_TEST_MAX_SIZE, input, fade_size);
+				for ( unsigned int i = 0 ; i < fade_size ; i++ )
+				{
+					expected[1][i] = input[fade_size - 1 - i];
+				}
+
+				level = DSP_SCALAR;
+				CrossFade(expected[0], expected[1], frames, 2, sample_size, 13, frames * 2);
+				level = (dsp_level)test_level;
+				CrossFade(actual[0], expected[1], frames, 2, sample_size, 13, frames * 2);
+				ok &= memcmp(expected[0], actual[0], fade_size) == 0;
+			}
+
+			// the float bus and back, which has to give back the input
+			for ( unsigned int sample_size = ONE_BYTE_SAMPLE ;
+				sample_size <= TWO_BYTE_SAMPLE ;
+				sample_size++ )
+			{
+				const unsigned int samples = SELF_TEST_FRAMES * 2;
+
+				level = DSP_SCALAR;
+				ToFloat(input, samples, sample_size, (float*)expected[0]);
+				FromFloat((const float*)expected[0], samples, sample_size, expected[1]);
+				level = (dsp_level)test_level;
+				ToFloat(input, samples, sample_size, (float*)actual[0]);
+				FromFloat((const float*)actual[0], samples, sample_size, actual[1]);
+
+				ok &= memcmp(expected[0], actual[0], samples * FOUR_BYTE_SAMPLE) == 0;
+				ok &= memcmp(expected[1], actual[1], samples * sample_size) == 0;
+				ok &= memcmp(input, actual[1], samples * sample_size) == 0;
+
+				for ( unsigned int channels = 1 ; channels <= SELF_TEST_CHANNELS ; channels++ )
+				{
+					const char *planes[SELF_TEST_CHANNELS];
+					for ( unsigned int c = 0 ; c < channels ; c++ )
+					{
+						planes[c] = input + (c * SELF_TEST_FRAMES * sample_size);
+					}
+
+					level = DSP_SCALAR;
+					Interleave(planes, SELF_TEST_FRAMES, channels, sample_size, expected[0]);
+					level = (dsp_level)test_level;
+					Interleave(planes, SELF_TEST_FRAMES, channels, sample_size, actual[0]);
+
+					ok &= memcmp(expected[0], actual[0], SELF_TEST_FRAMES * channels * sample_size) == 0;
+				}
+			}
+
+			// every conversion, with a tail that isn't a whole vector
+			for ( int format = SAMPLE_PCM24 ; format <= SAMPLE_FLOAT32 ; format++ )
+			{
+				const unsigned int samples = SELF_TEST_FRAMES * 2;
+
+				unsigned int expected_dither[DITHER_LANES];
+				unsigned int actual_dither[DITHER_LANES];
+				SeedDither(expected_dither);
+				SeedDither(actual_dither);
+
+				level = DSP_SCALAR;
+				ConvertTo16(input, samples, (sample_format)format, (short*)expected[0], expected_dither);
+				ConvertToFloat(input, samples, (sample_format)format, (float*)expected[1]);
+				level = (dsp_level)test_level;
+				ConvertTo16(input, samples, (sample_format)format, (short*)actual[0], actual_dither);
+				ConvertToFloat(input, samples, (sample_format)format, (float*)actual[1]);
+
+				ok &= memcmp(expected[0], actual[0], samples * TWO_BYTE_SAMPLE) == 0;
+				ok &= memcmp(expected[1], actual[1], samples * FOUR_BYTE_SAMPLE) == 0;
+				ok &= memcmp(expected_dither, actual_dither, sizeof(expected_dither)) == 0;
+			}
+
+			// 8 bit widened to 16 bit, with a tail that isn't a whole vector
+			{
+				const unsigned int samples = SELF_TEST_FRAMES * 2;
+
+				level = DSP_SCALAR;
+				Widen8To16((const unsigned char*)input, samples, (short*)expected[0]);
+				level = (dsp_level)test_level;
+				Widen8To16((const unsigned char*)input, samples, (short*)actual[0]);
+
+				ok &= memcmp(expected[0], actual[0], samples * TWO_BYTE_SAMPLE) == 0;
+			}
+
+			// a mix of every number of inputs, one of them with no gain
+			static float mix_planes[SELF_TEST_CHANNELS][SELF_TEST_FRAMES];
+			const float *mix_inputs[SELF_TEST_CHANNELS];
+			float gains[SELF_TEST_CHANNELS];
+
+			level = DSP_SCALAR;
+			for ( unsigned int c = 0 ; c < SELF_TEST_CHANNELS ; c++ )
+			{
+				ToFloat(
+					input + (c * SELF_TEST_FRAMES * TWO_BYTE_SAMPLE),
+					SELF_TEST_FRAMES,
+					TWO_BYTE_SAMPLE,
+					mix_planes[c]);
+				mix_inputs[c] = mix_planes[c];
+				gains[c] = (c == 1) ? 0.0f : 1.0f / (float)(c + 2);
+			}
+
+			for ( unsigned int inputs = 1 ; inputs <= SELF_TEST_CHANNELS ; inputs++ )
+			{
+				level = DSP_SCALAR;
+				MixPlanes(mix_inputs, gains, inputs, SELF_TEST_FRAMES, (float*)expected[0]);
+				level = (dsp_level)test_level;
+				MixPlanes(mix_inputs, gains, inputs, SELF_TEST_FRAMES, (float*)actual[0]);
+
+				ok &= memcmp(expected[0], actual[0], SELF_TEST_FRAMES * FOUR_BYTE_SAMPLE) == 0;
+			}
+
+			// a forward fft and an inverse one, swapping the parts
+			static float fft_twiddles[SELF_TEST_FFT_SIZE * 2];
+			SetupFft(SELF_TEST_FFT_SIZE, fft_twiddles);
+
+			for ( unsigned int part = 0 ; part < 2 ; part++ )
+			{
+				float *expected_re = (float*)expected[0];
+				float *expected_im = (float*)expected[1];
+				float *actual_re = (float*)actual[0];
+				float *actual_im = (float*)actual[1];
+
+				memcpy_s(expected_re, SELF_TEST_MAX_SIZE, mix_planes[part], SELF_TEST_FFT_SIZE * FOUR_BYTE_SAMPLE);
+				memcpy_s(expected_im, SELF_TEST_MAX_SIZE, mix_planes[part + 2], SELF_TEST_FFT_SIZE * FOUR_BYTE_SAMPLE);
+				memcpy_s(actual_re, SELF_TEST_MAX_SIZE, expected_re, SELF_TEST_FFT_SIZE * FOUR_BYTE_SAMPLE);
+				memcpy_s(actual_im, SELF_TEST_MAX_SIZE, expected_im, SELF_TEST_FFT_SIZE * FOUR_BYTE_SAMPLE);
+
+				level = DSP_SCALAR;
+				Fft(part ? expected_im : expected_re, part ? expected_re : expected_im, SELF_TEST_FFT_SIZE, fft_twiddles);
+				level = (dsp_level)test_level;
+				Fft(part ? actual_im : actual_re, part ? actual_re : actual_im, SELF_TEST_FFT_SIZE, fft_twiddles);
+
+				ok &= memcmp(expected_re, actual_re, SELF_TEST_FFT_SIZE * FOUR_BYTE_SAMPLE) == 0;
+				ok &= memcmp(expected_im, actual_im, SELF_TEST_FFT_SIZE * FOUR_BYTE_SAMPLE) == 0;
+			}
+		}
+
+		level = current;
+
+		return ok;
+	}
+}
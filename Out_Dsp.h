@@ -0,0 +1,191 @@
+#ifndef OUT_DSP_H
+#define OUT_DSP_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	typedef enum
+	{
+		DSP_SCALAR = 0,
+		DSP_SSE2,
+		DSP_AVX2
+	} dsp_level;
+
+	// the formats winamp can give us that have to be converted
+	typedef enum
+	{
+		SAMPLE_PCM24 = 0,
+		SAMPLE_PCM32,
+		SAMPLE_FLOAT32
+	} sample_format;
+
+	/*
+	 * The sample crunching routines used on the audio path. Each one
+	 * has a plain C version and vectorised versions, Initialise works
+	 * out what the CPU supports and picks the best from then on.
+	 */
+#ifndef NATIVE
+	public class Output_Dsp
+#else
+	class Output_Dsp
+#endif
+	{
+	public:
+		static void Initialise();
+
+		static inline dsp_level GetLevel()			{ return level; }
+		static void SetLevel(const dsp_level a_level);
+
+		/*
+		 * split interleaved audio (frames * channels samples, each
+		 * sample_size bytes) out to one buffer per channel
+		 */
+		static void Deinterleave(
+			const char *src,
+			const unsigned int frames,
+			const unsigned int channels,
+			const unsigned int sample_size,
+			char **dst);
+
+		/*
+		 * upmix to 4 channels, mono is copied to every speaker and
+		 * stereo is copied to the front and rear pairs. (dst) must
+		 * have room for four times as many samples as (src) for
+		 * mono and twice as many for stereo.
+		 */
+		static void ExpandMonoToQuad(
+			const char *src,
+			const unsigned int frames,
+			const unsigned int sample_size,
+			char *dst);
+
+		static void ExpandStereoToQuad(
+			const char *src,
+			const unsigned int frames,
+			const unsigned int sample_size,
+			char *dst);
+
+		/*
+		 * mix (frames) of (src) in to (dst) with equal power curves,
+		 * (dst) fading out and (src) fading in. (position) is how
+		 * many frames in to the (length) frame fade (dst) starts at
+		 */
+		static void CrossFade(
+			char *dst,
+			const char *src,
+			const unsigned int frames,
+			const unsigned int channels,
+			const unsigned int sample_size,
+			const unsigned int position,
+			const unsigned int length);
+
+		/*
+		 * the float bus, 8 bit, 16 bit and float samples to and from
+		 * floats between -1 and 1. going to float and back again
+		 * gives exactly what went in
+		 */
+		static void ToFloat(
+			const char *src,
+			const unsigned int samples,
+			const unsigned int sample_size,
+			float *dst);
+
+		static void FromFloat(
+			const float *src,
+			const unsigned int samples,
+			const unsigned int sample_size,
+			char *dst);
+
+		/*
+		 * the opposite of Deinterleave, one buffer per channel in to
+		 * interleaved audio
+		 */
+		static void Interleave(
+			const char **src,
+			const unsigned int frames,
+			const unsigned int channels,
+			const unsigned int sample_size,
+			char *dst);
+
+		/*
+		 * one output plane of a mixing matrix, (dst) is (frames) of
+		 * each of the (inputs) planes in (src) times its gain
+		 */
+		static void MixPlanes(
+			const float **src,
+			const float *gains,
+			const unsigned int inputs,
+			const unsigned int frames,
+			float *dst);
+
+		/*
+		 * in place fft of (size) complex points, a power of two, with
+		 * the real and imaginary parts in separate buffers. swapping
+		 * (re) and (im) gives the inverse, without the 1 / size.
+		 * (twiddles) is (size * 2) floats filled in by SetupFft
+		 */
+		static void SetupFft(const unsigned int size, float *twiddles);
+
+		static void Fft(
+			float *re,
+			float *im,
+			const unsigned int size,
+			const float *twiddles);
+
+		/*
+		 * convert (samples) of 24 bit, 32 bit or float audio to float,
+		 * or to 16 bit with triangular dither. (dither) is the state of
+		 * the noise, DITHER_LANES values set up by SeedDither
+		 */
+		static void ConvertToFloat(
+			const char *src,
+			const unsigned int samples,
+			const sample_format format,
+			float *dst);
+
+		static void ConvertTo16(
+			const char *src,
+			const unsigned int samples,
+			const sample_format format,
+			short *dst,
+			unsigned int *dither);
+
+		static void SeedDither(unsigned int *dither);
+
+		/*
+		 * unsigned 8 bit to signed 16 bit, for layouts open al only
+		 * has 16 bit formats for. nothing is lost so there's no dither
+		 */
+		static void Widen8To16(
+			const unsigned char *src,
+			const unsigned int samples,
+			short *dst);
+
+		// bytes in one sample of (format)
+		static unsigned int GetSampleSize(const sample_format format);
+
+		/*
+		 * millions of samples a second converted from (format) at
+		 * the current level, used to benchmark the conversions
+		 */
+		static double MeasureConversion(
+			const sample_format format,
+			const bool to_float);
+
+		/*
+		 * run every vectorised routine the cpu supports against
+		 * the scalar versions, true if they all agree
+		 */
+		static bool SelfTest();
+
+	private:
+
+		// what the cpu supports and what we're currently using
+		static dsp_level supported;
+		static dsp_level level;
+	};
+}
+
+#endif
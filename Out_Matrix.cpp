@@ -0,0 +1,310 @@
+#include "Out_Matrix.h"
+#include "ConfigFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+// -3dB, for one speaker spread over two
+#define MATRIX_HALF_POWER 0.70710678f
+
+namespace WinampOpenALOut
+{
+	typedef enum
+	{
+		SPEAKER_MONO = 0,
+		SPEAKER_FRONT_LEFT,
+		SPEAKER_FRONT_RIGHT,
+		SPEAKER_FRONT_CENTRE,
+		SPEAKER_LFE,
+		SPEAKER_BACK_LEFT,
+		SPEAKER_BACK_RIGHT,
+		SPEAKER_BACK_CENTRE,
+		SPEAKER_SIDE_LEFT,
+		SPEAKER_SIDE_RIGHT
+	} speaker;
+
+	// the speakers of each layout in the order winamp and open al use
+	static const speaker layouts[BUS_MAX_CHANNELS][BUS_MAX_CHANNELS] =
+	{
+		{ SPEAKER_MONO },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT, SPEAKER_FRONT_CENTRE },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT, SPEAKER_BACK_LEFT, SPEAKER_BACK_RIGHT },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT, SPEAKER_FRONT_CENTRE, 
+			SPEAKER_BACK_LEFT, SPEAKER_BACK_RIGHT },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT, SPEAKER_FRONT_CENTRE, SPEAKER_LFE, 
+			SPEAKER_BACK_LEFT, SPEAKER_BACK_RIGHT },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT, SPEAKER_FRONT_CENTRE, SPEAKER_LFE, 
+			SPEAKER_BACK_CENTRE, SPEAKER_SIDE_LEFT, SPEAKER_SIDE_RIGHT },
+		{ SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT, SPEAKER_FRONT_CENTRE, SPEAKER_LFE, 
+			SPEAKER_BACK_LEFT, SPEAKER_BACK_RIGHT, SPEAKER_SIDE_LEFT, SPEAKER_SIDE_RIGHT }
+	};
+
+	// where (role) is in a layout of (outputs) channels, -1 if it isn't
+	static int FindSpeaker(const unsigned int outputs, const speaker role)
+	{
+		for ( unsigned int o = 0 ; o < outputs ; o++ )
+		{
+			if ( layouts[outputs - 1][o] == role )
+			{
+				return (int)o;
+			}
+		}
+		return -1;
+	}
+
+	/*
+	 * add (gain) of input (input) to the output speaker (role), or to
+	 * the speakers nearest it if the output doesn't have one. every
+	 * output layout has either mono or a front pair, so it always
+	 * ends somewhere. the lfe is left out if there's no sub
+	 */
+	static void Place(
+		const unsigned int inputs,
+		const unsigned int outputs,
+		const unsigned int input,
+		const speaker role,
+		const float gain,
+		float *coefficients)
+	{
+		const int found = FindSpeaker(outputs, role);
+
+		if ( found >= 0 )
+		{
+			coefficients[(found * inputs) + input] += gain;
+			return;
+		}
+
+		const float half = gain * MATRIX_HALF_POWER;
+
+		switch ( role )
+		{
+		case SPEAKER_MONO:
+			if ( FindSpeaker(outputs, SPEAKER_FRONT_CENTRE) >= 0 )
+			{
+				Place(inputs, outputs, input, SPEAKER_FRONT_CENTRE, gain, coefficients);
+			}
+			else
+			{
+				Place(inputs, outputs, input, SPEAKER_FRONT_LEFT, half, coefficients);
+				Place(inputs, outputs, input, SPEAKER_FRONT_RIGHT, half, coefficients);
+			}
+			break;
+		case SPEAKER_FRONT_LEFT:
+		case SPEAKER_FRONT_RIGHT:
+			Place(inputs, outputs, input, SPEAKER_MONO, half, coefficients);
+			break;
+		case SPEAKER_FRONT_CENTRE:
+			Place(inputs, outputs, input, SPEAKER_FRONT_LEFT, half, coefficients);
+			Place(inputs, outputs, input, SPEAKER_FRONT_RIGHT, half, coefficients);
+			break;
+		case SPEAKER_LFE:
+			break;
+		case SPEAKER_BACK_LEFT:
+		case SPEAKER_SIDE_LEFT:
+		{
+			const speaker other = (role == SPEAKER_BACK_LEFT) ? SPEAKER_SIDE_LEFT : SPEAKER_BACK_LEFT;
+			if ( FindSpeaker(outputs, other) >= 0 )
+			{
+				Place(inputs, outputs, input, other, gain, coefficients);
+			}
+			else
+			{
+				Place(inputs, outputs, input, SPEAKER_FRONT_LEFT, half, coefficients);
+			}
+			break;
+		}
+		case SPEAKER_BACK_RIGHT:
+		case SPEAKER_SIDE_RIGHT:
+		{
+			const speaker other = (role == SPEAKER_BACK_RIGHT) ? SPEAKER_SIDE_RIGHT : SPEAKER_BACK_RIGHT;
+			if ( FindSpeaker(outputs, other) >= 0 )
+			{
+				Place(inputs, outputs, input, other, gain, coefficients);
+			}
+			else
+			{
+				Place(inputs, outputs, input, SPEAKER_FRONT_RIGHT, half, coefficients);
+			}
+			break;
+		}
+		case SPEAKER_BACK_CENTRE:
+			Place(inputs, outputs, input, SPEAKER_BACK_LEFT, half, coefficients);
+			Place(inputs, outputs, input, SPEAKER_BACK_RIGHT, half, coefficients);
+			break;
+		}
+	}
+
+	static bool IsLayout(const unsigned int inputs, const unsigned int outputs)
+	{
+		return inputs > 0 && inputs <= BUS_MAX_CHANNELS &&
+			outputs > 0 && outputs <= BUS_MAX_CHANNELS;
+	}
+
+	/*
+		build
+
+		place every input at its speaker in the output layout, then
+		scale down any output row whose gains add up to more than 1
+		so a sum of full scale inputs can't clip
+	*/
+	bool Output_Matrix::Build(
+		const unsigned int inputs,
+		const unsigned int outputs,
+		float *coefficients)
+	{
+		if ( !IsLayout(inputs, outputs) )
+		{
+			return false;
+		}
+
+		memset(coefficients, 0, inputs * outputs * sizeof(float));
+
+		for ( unsigned int i = 0 ; i < inputs ; i++ )
+		{
+			Place(inputs, outputs, i, layouts[inputs - 1][i], 1.0f, coefficients);
+		}
+
+		for ( unsigned int o = 0 ; o < outputs ; o++ )
+		{
+			float *row = coefficients + (o * inputs);
+			float total = 0.0f;
+
+			for ( unsigned int i = 0 ; i < inputs ; i++ )
+			{
+				total += row[i];
+			}
+
+			if ( total > 1.0f )
+			{
+				for ( unsigned int i = 0 ; i < inputs ; i++ )
+				{
+					row[i] /= total;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/*
+		build repeat
+
+		output (o) is a copy of input (o % inputs), the same as mono
+		and stereo expansion have always done
+	*/
+	bool Output_Matrix::BuildRepeat(
+		const unsigned int inputs,
+		const unsigned int outputs,
+		float *coefficients)
+	{
+		if ( !IsLayout(inputs, outputs) )
+		{
+			return false;
+		}
+
+		memset(coefficients, 0, inputs * outputs * sizeof(float));
+
+		for ( unsigned int o = 0 ; o < outputs ; o++ )
+		{
+			coefficients[(o * inputs) + (o % inputs)] = 1.0f;
+		}
+
+		return true;
+	}
+
+	/*
+		load
+
+		the gains are kept as a comma separated list, row by row, under
+		MatrixNtoM for N inputs and M outputs
+	*/
+	bool Output_Matrix::Load(
+		const unsigned int inputs,
+		const unsigned int outputs,
+		float *coefficients)
+	{
+		if ( !IsLayout(inputs, outputs) )
+		{
+			return false;
+		}
+
+		char name[MATRIX_CONFIG_NAME_SIZE] = {'\0'};
+		sprintf_s(name, MATRIX_CONFIG_NAME_SIZE, CONF_MATRIX, inputs, outputs);
+
+		char value[MATRIX_CONFIG_SIZE] = {'\0'};
+		ConfigFile::ReadString(name, value, MATRIX_CONFIG_SIZE);
+
+		const unsigned int wanted = inputs * outputs;
+		unsigned int count = 0;
+		const char *at = value;
+
+		while ( *at != '\0' && count < wanted )
+		{
+			char *end = NULL;
+			const double gain = strtod(at, &end);
+
+			if ( end == at )
+			{
+				return false;
+			}
+
+			coefficients[count++] = (float)gain;
+
+			at = end;
+			while ( *at == ' ' || *at == ',' )
+			{
+				at++;
+			}
+		}
+
+		return count == wanted && *at == '\0';
+	}
+
+	/*
+		is routing
+
+		a row with a single gain of 1 copies that input, if every
+		row does the bus can route instead of mixing
+	*/
+	bool Output_Matrix::IsRouting(
+		const unsigned int inputs,
+		const unsigned int outputs,
+		const float *coefficients,
+		unsigned int *route)
+	{
+		for ( unsigned int o = 0 ; o < outputs ; o++ )
+		{
+			const float *row = coefficients + (o * inputs);
+			int source = -1;
+
+			for ( unsigned int i = 0 ; i < inputs ; i++ )
+			{
+				if ( row[i] == 0.0f )
+				{
+					continue;
+				}
+
+				if ( row[i] != 1.0f || source >= 0 )
+				{
+					return false;
+				}
+
+				source = (int)i;
+			}
+
+			if ( source < 0 )
+			{
+				return false;
+			}
+
+			route[o] = (unsigned int)source;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef OUT_MATRIX_H
+#define OUT_MATRIX_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * Mixing matrices between channel layouts. A matrix has one row
+	 * per output channel and one gain per input channel in each row,
+	 * so (coefficients) is outputs * inputs floats. Layouts follow
+	 * the wave channel order, 1 to 8 channels.
+	 */
+#ifndef NATIVE
+	public class Output_Matrix
+#else
+	class Output_Matrix
+#endif
+	{
+	public:
+		/*
+		 * the default up or down mix, every input speaker goes to the
+		 * same speaker if the output has one or is spread over its
+		 * nearest neighbours if not. rows are scaled down so they
+		 * can't clip
+		 */
+		static bool Build(
+			const unsigned int inputs,
+			const unsigned int outputs,
+			float *coefficients);
+
+		// each output takes input (output % inputs), how expansion works
+		static bool BuildRepeat(
+			const unsigned int inputs,
+			const unsigned int outputs,
+			float *coefficients);
+
+		/*
+		 * a matrix from the config, false if there isn't one for this
+		 * pair of layouts or it doesn't have outputs * inputs gains
+		 */
+		static bool Load(
+			const unsigned int inputs,
+			const unsigned int outputs,
+			float *coefficients);
+
+		/*
+		 * true if every output is just a copy of one input, (route)
+		 * gets the input each output copies
+		 */
+		static bool IsRouting(
+			const unsigned int inputs,
+			const unsigned int outputs,
+			const float *coefficients,
+			unsigned int *route);
+	};
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "Out_Position.h"
+#include "Out_Stats.h"
+
+namespace WinampOpenALOut
+{
+	Output_Position::Output_Position()
+	{
+		sequence = 0;
+		extrapolate = false;
+
+		memset(&current, 0, sizeof(position_snapshot));
+		current.rate = 1.0;
+	}
+
+	/*
+		publish
+
+		there's only ever one writer so the count just has to be
+		odd while the fields are changing
+	*/
+	void Output_Position::Publish(const position_snapshot *snapshot)
+	{
+		InterlockedIncrement(&sequence);
+
+		current = *snapshot;
+
+		InterlockedIncrement(&sequence);
+	}
+
+	/*
+		read
+
+		copy the snapshot out, trying again if it was being
+		published at the time
+	*/
+	void Output_Position::Read(position_snapshot *snapshot)
+	{
+		LONG before;
+		LONG after;
+
+		do
+		{
+			before = sequence;
+			while ( before & 1 )
+			{
+				YieldProcessor();
+				before = sequence;
+			}
+
+			MemoryBarrier();
+			*snapshot = current;
+			MemoryBarrier();
+
+			after = sequence;
+		}
+		while ( before != after );
+	}
+
+	bool Output_Position::IsStale()
+	{
+		position_snapshot snapshot;
+		Read(&snapshot);
+
+		return (Output_Stats::GetSeconds() - snapshot.taken_at) * ONE_SECOND_IN_MS > 
+			POSITION_STALE_MS;
+	}
+
+	/*
+		get output time
+
+		the published output time, if extrapolation is on and the
+		sources are running it's moved on by the time since it was
+		taken. that's never more than POSITION_EXTRAPOLATE_MS and
+		never past what's been written
+	*/
+	int Output_Position::GetOutputTime()
+	{
+		position_snapshot snapshot;
+		Read(&snapshot);
+
+		if ( !extrapolate || !snapshot.running )
+		{
+			return snapshot.output_ms;
+		}
+
+		double elapsed_ms = (Output_Stats::GetSeconds() - snapshot.taken_at) * ONE_SECOND_IN_MS;
+		if ( elapsed_ms < 0.0 )
+		{
+			elapsed_ms = 0.0;
+		}
+		else if ( elapsed_ms > POSITION_EXTRAPOLATE_MS )
+		{
+			elapsed_ms = POSITION_EXTRAPOLATE_MS;
+		}
+
+		int position = snapshot.output_ms + (int)(elapsed_ms * snapshot.rate);
+		if ( position > snapshot.written_ms )
+		{
+			position = snapshot.output_ms > snapshot.written_ms ? 
+				snapshot.output_ms : snapshot.written_ms;
+		}
+
+		return position;
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef OUT_POSITION_H
+#define OUT_POSITION_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	typedef struct
+	{
+		// the times winamp is given, in ms
+		int			output_ms;
+		int			written_ms;
+
+		// bytes played and written, shown on the status form
+		__int64		played_bytes;
+		__int64		written_bytes;
+
+		// how fast the output clock is running and when this was taken
+		double		rate;
+		double		taken_at;
+		bool		running;
+	} position_snapshot;
+
+	/*
+	 * The play position as last worked out by the audio path. It's
+	 * published with a sequence count so any thread can read it
+	 * without a lock and without asking open al, a reader that
+	 * overlaps a publish just reads it again. Between publishes the
+	 * output time can be moved on from the performance counter.
+	 */
+#ifndef NATIVE
+	public class Output_Position
+#else
+	class Output_Position
+#endif
+	{
+	public:
+		Output_Position();
+
+		// only called by the thread holding the output lock
+		void Publish(const position_snapshot *snapshot);
+		void Read(position_snapshot *snapshot);
+
+		// true if the snapshot is older than POSITION_STALE_MS
+		bool IsStale();
+
+		int GetOutputTime();
+		inline int GetWrittenTime()
+		{
+			position_snapshot snapshot;
+			Read(&snapshot);
+			return snapshot.written_ms;
+		}
+		inline __int64 GetPlayedBytes()
+		{
+			position_snapshot snapshot;
+			Read(&snapshot);
+			return snapshot.played_bytes;
+		}
+		inline __int64 GetWrittenBytes()
+		{
+			position_snapshot snapshot;
+			Read(&snapshot);
+			return snapshot.written_bytes;
+		}
+
+		inline bool IsExtrapolated()			{ return extrapolate; }
+		inline void SetExtrapolated(const bool enabled)	{ extrapolate = enabled; }
+
+	protected:
+
+		// odd while a publish is in progress
+		volatile LONG		sequence;
+		position_snapshot	current;
+
+		bool				extrapolate;
+	};
+}
+
+#endif
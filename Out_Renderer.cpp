@@ -33,6 +33,10 @@ namespace WinampOpenALOut
 		number_of_channels = 0;
 		bits_per_sample = 0;
 		number_of_buffers = 0;
+		active_buffers = 0;
+		chunk_frames = 0;
+		chunk_size = 0;
+		underruns = 0;
 		bytes_per_sample_channel = 0;
 		volume = 0;
 		played = 0;
@@ -40,6 +44,8 @@ namespace WinampOpenALOut
 		last_pause = 0;
 		format = 0;
 		calculated_buffer_size = 0;
+		next_buffer_index = 0;
+		queue_head = 0;
 
 		memset(buffers, 0, sizeof(buffer_type) * MAX_NO_BUFFERS);
 
@@ -59,11 +65,8 @@ namespace WinampOpenALOut
 	{
 
 		ALint	buffers_processed = 0;
-		ALuint	next_buffer = 0;
 		ALenum	err = AL_NO_ERROR;
 
-		unsigned int selected_buffer = 0u;
-
 		buffers_processed = NO_BUFFERS_PROCESSED;
 
 		// ask open al how many buffers have been processed
@@ -85,6 +88,11 @@ namespace WinampOpenALOut
 			onError();
 		}
 
+		if ( buffers_processed <= 0 )
+		{
+			return;
+		}
+
 #ifdef _DEBUGGING
 		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
 		sprintf_s(
@@ -94,93 +102,75 @@ namespace WinampOpenALOut
 		this->log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
 
-		while (buffers_processed--)
+		if ( buffers_processed > (ALint)(number_of_buffers - number_buffers_free) )
 		{
-			next_buffer = DEFAULT_BUFFER;
-			
-			// clear any open al errors
-			alGetError();
+			buffers_processed = number_of_buffers - number_buffers_free;
+		}
 
-			/* unqueue *any* processed buffer. the buffer that has been
-				processed will be put into uiNextBuffer */
-			alSourceUnqueueBuffers(
-				source,
-				GET_ONE_BUFFER,
-				&next_buffer); 
+		/* unqueue all the processed buffers in one go, open al hands
+			them back in the order they were queued */
+		ALuint processed[MAX_NO_BUFFERS];
 
-			// based on the bufferID determine the buffer index
-			selected_buffer = UNKNOWN_BUFFER;
-			for(unsigned int buffer_index=0 ; buffer_index < number_of_buffers ; buffer_index++)
-			{
-				if( (!buffers[buffer_index].available) && 
-					buffers[buffer_index].buffer_id == next_buffer )
-				{
-					selected_buffer = buffer_index;
+		alGetError();
+		alSourceUnqueueBuffers(
+			source,
+			buffers_processed,
+			processed);
 
-					if ( buffers[buffer_index].data != NULL )
-					{
-						delete buffers[buffer_index].data;
-						buffers[buffer_index].data = NULL;
-					}
+		if( alGetError() != AL_NO_ERROR )
+		{
+			MessageBoxA(NULL, "Error in Monitor Thread - Out of Range", "Error Monitoring", MB_OK);
+			this->onError();
+			return;
+		}
 
-					buffers[buffer_index].available = true;
-					number_buffers_free++;
-#ifdef _DEBUGGING
-		sprintf_s(
-			dbg,
-			DEBUG_BUFFER_SIZE,
-			"the buffer was index %d", buffer_index);
-		this->log_debug_msg(dbg, __FILE__, __LINE__);
-#endif
-					break;
-				}
-			}
+		/* buffers are queued in index order by Write so the oldest
+			one in the queue is always at (queue_head) */
+		for ( ALint processed_index = 0 ; processed_index < buffers_processed ; processed_index++ )
+		{
+			buffer_type *buffer = &buffers[queue_head];
 
 #ifdef _DEBUGGING
-			if ( selected_buffer == UNKNOWN_BUFFER )
+			if ( buffer->buffer_id != processed[processed_index] || buffer->available )
 			{
-		sprintf_s(
-			dbg,
-			DEBUG_BUFFER_SIZE,
-			"!! couldn't find processed buffer %d", next_buffer);
-		this->log_debug_msg(dbg, __FILE__, __LINE__);
+				sprintf_s(
+					dbg,
+					DEBUG_BUFFER_SIZE,
+					"!! processed buffer %d isn't the head of the queue (%d)",
+					processed[processed_index],
+					queue_head);
+				this->log_debug_msg(dbg, __FILE__, __LINE__);
 			}
 #endif
+#ifdef _DEBUG
+			_ASSERTE( buffer->buffer_id == processed[processed_index] );
+#endif
 
-			/* if no errors have occured we can mark that
-				buffer as available again */
-			if(alGetError() == AL_NO_ERROR)
-			{
-				/* increase our played time position
-				 (the delta for where we are in the current buffer is done
-				 in get_output_time */
-				buffer_size_free += buffers[selected_buffer].size;
-				played += buffers[selected_buffer].size;
-				buffers[selected_buffer].size = 0;
-
-			} else { 
-				MessageBoxA(NULL, "Error in Monitor Thread - Out of Range", "Error Monitoring", MB_OK);
-				this->onError();
-			}
-		}
-	}
+			/* increase our played time position
+			 (the delta for where we are in the current buffer is done
+			 in get_output_time */
+			buffer_size_free += buffer->size;
+			played += buffer->size;
+			buffer->size = 0;
+			buffer->available = true;
+			number_buffers_free++;
 
-	static DWORD PlayThread(LPVOID renderer)
-	{
-		((Output_Renderer*)renderer)->Play();
-		return 0;
+			queue_head = (queue_head + 1) % number_of_buffers;
+		}
 	}
 
-	void Output_Renderer::Play()
-	{
-		alSourcePlay(this->source);
-	}
+	/*
+		check play state
 
-	HANDLE Output_Renderer::CheckPlayState()
+		returns true if the source has buffers queued but isn't
+		playing, the caller starts all the sources that need it
+		together so they stay in step
+	*/
+	bool Output_Renderer::CheckPlayState()
 	{
 		ALint	state = AL_SOURCE_STATE;
 		ALint	queued_buffers = 0;
-		HANDLE thread_handle = NULL;
+		bool	needs_start = false;
 
 		/*
 			can the current state of the source
@@ -203,8 +193,21 @@ namespace WinampOpenALOut
 			if(stream_open && 
 				(state == AL_STOPPED))
 			{
-				is_playing = false;
-				return thread_handle;
+				/*
+				 * if we were playing the source has run out of data,
+				 * it's started again below once there's more queued
+				 */
+				if ( is_playing )
+				{
+					underruns++;
+					is_playing = false;
+				}
+
+				/*
+				 * playing a stopped source starts from the front of
+				 * its queue, so anything already heard has to go
+				 */
+				this->CheckProcessedBuffers();
 			}
 
 			// if we're not playing check to see if any buffers are queued
@@ -222,15 +225,7 @@ namespace WinampOpenALOut
 				// if any buffers are queued and we're not playing - play!
 				if(!last_pause && !is_playing)
 				{
-					DWORD id = 0;
-
-					thread_handle = CreateThread(
-						NULL, 
-						0x1000,
-						(LPTHREAD_START_ROUTINE)&PlayThread,
-						this, 
-						CREATE_SUSPENDED, 
-						&id);
+					needs_start = true;
 
 #ifdef _DEBUGGING
 					char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
@@ -249,7 +244,46 @@ namespace WinampOpenALOut
 			}
 		}
 
-		return thread_handle;
+		return needs_start;
+	}
+
+	/*
+		get played frames
+
+		the frames this source has played, (played) only moves when a
+		whole buffer finishes so the offset in to the current one is
+		added. if the driver supports AL_SOFT_source_latency the time
+		until the current frame is heard is put in (latency_ns)
+	*/
+	unsigned __int64 Output_Renderer::GetPlayedFrames(__int64 * latency_ns)
+	{
+		__int64 offset = 0;
+
+		*latency_ns = 0;
+
+		if ( bytes_per_sample_channel == 0 )
+		{
+			return 0;
+		}
+
+		if ( alGetSourcei64vSOFT != NULL )
+		{
+			// the offset is 32.32 fixed point, the latency is in ns
+			ALint64SOFT values[2] = {0, 0};
+			alGetSourcei64vSOFT(source, AL_SAMPLE_OFFSET_LATENCY_SOFT, values);
+
+			offset = values[0] >> 32;
+			*latency_ns = values[1];
+		}
+		else
+		{
+			ALint sample_offset = 0;
+			alGetSourcei(source, AL_SAMPLE_OFFSET, &sample_offset);
+
+			offset = sample_offset;
+		}
+
+		return (played / bytes_per_sample_channel) + offset;
 	}
 
 	void Output_Renderer::log_debug_msg(char* msg, char* file, int line)
@@ -263,6 +297,46 @@ namespace WinampOpenALOut
 #endif
 	}
 
+	/*
+		get format
+
+		the open al format for (channels) of (bits) audio, 0 if the
+		device doesn't have one. 32 bit audio is always float
+	*/
+	ALenum Output_Renderer::GetFormat(const int channels, const int bits)
+	{
+		const bool is_float = (bits == THIRTY_TWO_BIT_PER_SAMPLE);
+
+		switch(channels)
+		{
+			case 1:
+				return bits == 8 ? alGetEnumValue("AL_FORMAT_MONO8") : 
+					is_float ? alGetEnumValue("AL_FORMAT_MONO_FLOAT32") : alGetEnumValue("AL_FORMAT_MONO16");
+			case 2:
+				return bits == 8 ? alGetEnumValue("AL_FORMAT_STEREO8") : 
+					is_float ? alGetEnumValue("AL_FORMAT_STEREO_FLOAT32") : alGetEnumValue("AL_FORMAT_STEREO16");
+			case 4:
+				return bits == 8 ? alGetEnumValue("AL_FORMAT_QUAD8") : 
+					is_float ? alGetEnumValue("AL_FORMAT_QUAD32") : alGetEnumValue("AL_FORMAT_QUAD16");
+			case 6:
+				return bits == 8 ? alGetEnumValue("AL_FORMAT_51CHN8") : 
+					is_float ? alGetEnumValue("AL_FORMAT_51CHN32") : alGetEnumValue("AL_FORMAT_51CHN16");
+			case 7:
+				return bits == 8 ? alGetEnumValue("AL_FORMAT_61CHN8") : 
+					is_float ? alGetEnumValue("AL_FORMAT_61CHN32") : alGetEnumValue("AL_FORMAT_61CHN16");
+			case 8:
+				return bits == 8 ? alGetEnumValue("AL_FORMAT_71CHN8") : 
+					is_float ? alGetEnumValue("AL_FORMAT_71CHN32") : alGetEnumValue("AL_FORMAT_71CHN16");
+		};
+
+		return 0;
+	}
+
+	bool Output_Renderer::IsFormatSupported(const int channels, const int bits)
+	{
+		return GetFormat(channels, bits) != 0;
+	}
+
 	/*
 		open
 
@@ -280,9 +354,15 @@ namespace WinampOpenALOut
 	{	
 		SYNC_START;
 
-		if(bitspersamp > SIXTEEN_BIT_PER_SAMPLE)
+		/*
+		 * 32 bit audio is always float, Output_Wumpus converts
+		 * anything else down to 16 bit
+		 */
+		if(bitspersamp != EIGHT_BIT_PER_SAMPLE &&
+			bitspersamp != SIXTEEN_BIT_PER_SAMPLE &&
+			bitspersamp != THIRTY_TWO_BIT_PER_SAMPLE)
 		{
-			MessageBoxA(NULL, "This Plug-In only supports 8 and 16bit audio, please disable 24bit audio in Winamp", "Whoops", MB_OK);
+			MessageBoxA(NULL, "This Plug-In only supports 8, 16 and float audio", "Whoops", MB_OK);
 			SYNC_END;
 			return -1;
 		}
@@ -304,27 +384,23 @@ namespace WinampOpenALOut
 		bits_per_sample = bitspersamp;
 
 		// determine the format to output in
-		switch(number_of_channels)
+		format = GetFormat(number_of_channels, bits_per_sample);
+
+		// the device doesn't have this layout, nothing can be queued
+		if ( format == 0 )
 		{
-			case 1:
-				format = bits_per_sample == 8 ? alGetEnumValue("AL_FORMAT_MONO8") : alGetEnumValue("AL_FORMAT_MONO16");
-				break;
-			case 2:
-				format = bits_per_sample == 8 ? alGetEnumValue("AL_FORMAT_STEREO8") : alGetEnumValue("AL_FORMAT_STEREO16");
-				break;
-			case 4:
-				format = alGetEnumValue("AL_FORMAT_QUAD16");
-				break;
-			case 6:
-				format = alGetEnumValue("AL_FORMAT_51CHN16");
-				break;
-			case 7:
-				format = alGetEnumValue("AL_FORMAT_61CHN16");
-				break;
-			case 8:
-				format = alGetEnumValue("AL_FORMAT_71CHN16");
-				break;
-		};
+#ifdef _DEBUGGING
+			sprintf_s(
+				dbg,
+				DEBUG_BUFFER_SIZE,
+				"Open: no format for {%d} channels of {%d} bits",
+				numchannels,
+				bitspersamp);
+			log_debug_msg(dbg, __FILE__, __LINE__);
+#endif
+			SYNC_END;
+			return -1;
+		}
 
 		// reset the play position back to zero
 		last_pause = 0;
@@ -333,10 +409,24 @@ namespace WinampOpenALOut
 		// determine the size of the buffer
 		bytes_per_sample_channel = ((bits_per_sample >> SHIFT_BITS_TO_BYTES)*number_of_channels);
 
-		calculated_buffer_size = (bytes_per_sample_channel * (sample_rate / ONE_SECOND_IN_MS)) * conf_buffer_length;
+		/*
+		 * every buffer holds a whole number of frames, either enough
+		 * for the duration asked for or as many as fit in
+		 * MAXIMUM_BUFFER_SIZE
+		 */
+		if ( chunk_frames > 0 )
+		{
+			chunk_size = chunk_frames * bytes_per_sample_channel;
+		}
+		else
+		{
+			chunk_size = (MAXIMUM_BUFFER_SIZE / bytes_per_sample_channel) * bytes_per_sample_channel;
+		}
+
+		calculated_buffer_size = (unsigned int)
+			(((unsigned __int64)bytes_per_sample_channel * sample_rate * conf_buffer_length) / ONE_SECOND_IN_MS);
 
-		//noBuffers = MAX_NO_BUFFERS;
-		number_of_buffers = (calculated_buffer_size / MAXIMUM_BUFFER_SIZE);// + MAXIMUM_BUFFER_OFFSET;
+		number_of_buffers = calculated_buffer_size / chunk_size;
 
 		// if we have no buffers just assume we can use at least (MINIMUM_BUFFERS)
 		// we need more than one so we can listen to one and write t'other
@@ -351,15 +441,19 @@ namespace WinampOpenALOut
 		}
 
 		next_buffer_index = 0;
-		this->buffer_size_free = number_of_buffers * MAXIMUM_BUFFER_SIZE;
+		queue_head = 0;
+		active_buffers = number_of_buffers;
+		underruns = 0;
+		this->buffer_size_free = number_of_buffers * chunk_size;
 		this->number_buffers_free = number_of_buffers;
 
 #ifdef _DEBUGGING
 		sprintf_s(
 			dbg,
 			DEBUG_BUFFER_SIZE,
-			"-> Using {%d} buffers for total size of {%d}", 
+			"-> Using {%d} buffers of {%d} bytes for total size of {%d}", 
 			number_of_buffers,
+			chunk_size,
 			calculated_buffer_size);
 		this->log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
@@ -376,11 +470,6 @@ namespace WinampOpenALOut
 			buffers[buffer_index].buffer_id = 0;
 			buffers[buffer_index].size = 0;
 			buffers[buffer_index].available = false;
-			if ( buffers[buffer_index].data )
-			{
-				delete buffers[buffer_index].data;
-				buffers[buffer_index].data = NULL;
-			}
 		}
 
 		for(unsigned int buffer_index=0 ; buffer_index<number_of_buffers ; buffer_index++)
@@ -509,36 +598,22 @@ namespace WinampOpenALOut
 
 		stream_open = false;
 
-		// stop the source
+		/* stop the source, Output_Wumpus normally stops all of them
+		 * together first so this does nothing. stopping is immediate
+		 * and every buffer on a stopped source counts as processed,
+		 * so they can all be taken off the queue straight away
+		 */
 		alSourceStop(source);
+		alSourcei(source, AL_BUFFER, 0);
 
 		played = 0;
 
-		ALint state = 0;
-		unsigned int timeout = 0;
-		// query the state of the source and wait for it to stop
-		alGetSourcei(source, AL_SOURCE_STATE, &state);
-		while(state != AL_STOPPED && state != AL_INITIAL)
+		for(unsigned int buffer_index=0 ; buffer_index<number_of_buffers ; buffer_index++)
 		{
-			Sleep(1);
-			if(timeout++ > CLOSE_TIMEOUT_COUNT) {
-				break;
-			}
+			buffers[buffer_index].available = true;
+			buffers[buffer_index].size = 0;
 		}
-
-		int count_timeout = 0;
-		// wait for all the buffers to be used up
-		while(number_buffers_free != number_of_buffers)
-		{
-			CheckProcessedBuffers();
-			Sleep(1);
-			if ( ++count_timeout > CLOSE_TIMEOUT_COUNT )
-			{
-				break;
-			}
-		}
-		// remove all buffers
-		alSourcei(source, AL_BUFFER, 0);
+		number_buffers_free = number_of_buffers;
 
 		// delete the source
 		alDeleteSources( 1, &source );
@@ -550,17 +625,6 @@ namespace WinampOpenALOut
 			buffers[buffer_index].buffer_id = 0;
 		}
 
-		// make sure all memory from the buffers is freed up,
-		// if CheckProcessed is working correct this shouldn't run
-		for(unsigned int buffer_index=0 ; buffer_index<number_of_buffers ; buffer_index++)
-		{
-			if ( buffers[buffer_index].data != NULL )
-			{
-				delete buffers[buffer_index].data;
-				buffers[buffer_index].data = NULL;
-			}
-		}
-
 		// just incase the thread has exitted, assume playing has stopped
 		is_playing = false;
 
@@ -575,6 +639,39 @@ namespace WinampOpenALOut
 
 	}
 
+	/*
+		reset
+
+		empty the queue but keep the source and the buffers, the
+		source has to be stopped first. a stopped source counts
+		every buffer as processed so they can all be taken off
+	*/
+	void Output_Renderer::Reset()
+	{
+		SYNC_START;
+
+		alSourceStop(source);
+		alSourcei(source, AL_BUFFER, 0);
+
+		// any drift correction was for the old position
+		alSourcef(source, AL_PITCH, 1.0f);
+
+		for(unsigned int buffer_index=0 ; buffer_index<number_of_buffers ; buffer_index++)
+		{
+			buffers[buffer_index].available = true;
+			buffers[buffer_index].size = 0;
+		}
+
+		number_buffers_free = number_of_buffers;
+		buffer_size_free = number_of_buffers * chunk_size;
+		next_buffer_index = 0;
+		queue_head = 0;
+		played = 0;
+		is_playing = false;
+
+		SYNC_END;
+	}
+
 	/*
 		write
 
@@ -588,7 +685,7 @@ namespace WinampOpenALOut
 		ALenum err = AL_NO_ERROR;
 
 		// if we cannot write exit now (non-blocking op)
-		if(number_buffers_free == 0 || !stream_open)
+		if( !HasFreeBuffer() )
 		{
 			SYNC_END;
 			return;
@@ -611,19 +708,12 @@ namespace WinampOpenALOut
 			ALuint next_buffer = UNKNOWN_BUFFER;
 			unsigned int selected_buffer = UNKNOWN_BUFFER;
 
-			/*	go through the buffers and find an available one
-
-				if we're here (critical section, canWrite=true) then
-				we assume that one is! 
+			/*	buffers are used in order and come back in order,
+				so the free ones always start at (next_buffer_index)
 			*/
-
-			/* this block shouldn't be needed but it just makes
-			 * sure that the next buffer is available
-			 */
-			while ( !buffers[next_buffer_index].available )
-			{
-				next_buffer_index++;
-			}
+#ifdef _DEBUG
+			_ASSERTE( buffers[next_buffer_index].available );
+#endif
 
 			/* allocate the next buffer */
 			next_buffer = buffers[next_buffer_index].buffer_id;
@@ -650,10 +740,9 @@ namespace WinampOpenALOut
 			buffer_size_free -= len;
 
 			/*
-			 * track the buffer so we can delete it from the heap
-			 * and track our play time
+			 * track the buffer size for our play time, open al copies
+			 * the data so the caller keeps ownership of (buf)
 			 */
-			buffers[selected_buffer].data = (void*)buf;
 			buffers[selected_buffer].size = len;
 
 #ifdef _DEBUGGING
@@ -729,7 +818,20 @@ namespace WinampOpenALOut
 
 			this->CheckProcessedBuffers();
 
-			r = ((number_buffers_free > 0) ? buffer_size_free : 0);
+			/*
+			 * the buffers past (active_buffers) don't count as space
+			 */
+			const unsigned int inactive_size = 
+				(number_of_buffers - active_buffers) * chunk_size;
+
+			if ( HasFreeBuffer() && buffer_size_free > inactive_size )
+			{
+				r = buffer_size_free - inactive_size;
+			}
+			else
+			{
+				r = 0;
+			}
 		}
 
 		SYNC_END;
@@ -758,29 +860,15 @@ namespace WinampOpenALOut
 	/*
 		pause
 
+		records the pause state, the sources of all the renderers
+		are paused and played together by Output_Wumpus
+
 		returns the previous pause state
 	*/
 	int Output_Renderer::Pause(const int pause)
 	{
 		SYNC_START;
 		last_pause = pause;
-		
-		// clear the error state
-		alGetError();
-
-		// if this is un-paused during pre-buffering
-		// we may start to play data before it's ready
-		// and cause and under-run
-		if(stream_open)
-		{
-			if(pause)
-			{
-				alSourcePause(source);
-			}else{
-				alSourcePlay(source);
-			}
-		}
-
 		SYNC_END;
 		return last_pause;
 	}
@@ -799,19 +887,51 @@ namespace WinampOpenALOut
 	}
 
 	/*
-		flush
+		set gain
 
-		this procedure is invoked by winamp to flush the buffers
-		and start playing from time (t)ms.
+		change the gain of the source but not the volume, used
+		while it's being ramped up or down
 	*/
-	void Output_Renderer::Flush()
+	void Output_Renderer::SetGain(const ALfloat gain)
 	{
-		SYNC_START;
+		alSourcef(source, AL_GAIN, gain);
+	}
 
-		// make sure we've stopped playing
-		alSourceStop(source);
+	/*
+		set pitch
 
-		SYNC_END;
+		only used to keep split sources in step so it's never far
+		from 1.0
+	*/
+	void Output_Renderer::SetPitch(const ALfloat pitch)
+	{
+		alSourcef(source, AL_PITCH, pitch);
+	}
+
+	/*
+		set queue length
+
+		use enough of the buffers to hold (ms) of audio, never more
+		than were made in Open
+	*/
+	void Output_Renderer::SetQueueLength(const unsigned int ms)
+	{
+		const unsigned __int64 bytes = 
+			((unsigned __int64)bytes_per_sample_channel * sample_rate * ms) / ONE_SECOND_IN_MS;
+
+		unsigned int buffers_needed = 
+			chunk_size > 0 ? (unsigned int)(bytes / chunk_size) : number_of_buffers;
+
+		if ( buffers_needed < MINIMUM_BUFFERS )
+		{
+			buffers_needed = MINIMUM_BUFFERS;
+		}
+		if ( buffers_needed > number_of_buffers )
+		{
+			buffers_needed = number_of_buffers;
+		}
+
+		active_buffers = buffers_needed;
 	}
 
 	void Output_Renderer::SetXRAMEnabled( const bool enabled )
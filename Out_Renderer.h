@@ -18,7 +18,6 @@ namespace WinampOpenALOut
 			ALuint buffer_id;
 			bool available;
 			unsigned int size;
-			void* data;
 		} buffer_type;
 
 	public:
@@ -35,37 +34,65 @@ namespace WinampOpenALOut
 			const int bufferlenms, 
 			const int prebufferms);
 		void Close();
+		void Reset();
 		void Write(
 			const char *buf,
 			const int len);
 		int CanWrite();
 		bool IsPlaying();
 		int Pause(const int pause);
-		void Flush();
+
+		/*
+		 * the open al format Open would use, 0 if there isn't one
+		 * for this many channels on the current device
+		 */
+		static ALenum GetFormat(const int channels, const int bits);
+		static bool IsFormatSupported(const int channels, const int bits);
 
 		inline bool IsStreamOpen()						{ return stream_open; }
 		void SetXRAMEnabled( const bool enabled );
 
+		/*
+		 * how many frames go in each open al buffer, set before Open.
+		 * zero fills them up to MAXIMUM_BUFFER_SIZE bytes
+		 */
+		inline void SetChunkFrames(const unsigned int frames)	{ chunk_frames = frames; }
+		inline unsigned int GetChunkSize()				{ return chunk_size; }
+
 		inline unsigned int GetBufferFree(void)
 		{
 			return buffer_size_free;
 		}
 
+		/*
+		 * only (active_buffers) of the buffers are used at once so
+		 * the queue can be made shorter without reopening
+		 */
+		inline bool HasFreeBuffer(void)
+		{
+			return stream_open && 
+				number_buffers_free > 0 &&
+				(number_of_buffers - number_buffers_free) < active_buffers;
+		}
+
+		void SetQueueLength(const unsigned int ms);
+		inline unsigned int GetUnderruns()				{ return underruns; }
+
 		void CheckProcessedBuffers();
-		inline void Play();
-		HANDLE CheckPlayState();
+		bool CheckPlayState();
+
+		inline ALuint GetSource()						{ return source; }
+		// as of the last CheckPlayState
+		inline bool IsSourcePlaying()					{ return is_playing; }
 		void SetVolumeInternal(const ALfloat new_volume);
+		void SetGain(const ALfloat gain);
+		void SetPitch(const ALfloat pitch);
 		
-		inline unsigned long long GetPlayedTime()
-		{
-			ALint delta_bytes = 0;
-			alGetSourcei(source, AL_BYTE_OFFSET, &delta_bytes);
-			return played + delta_bytes;
-		}
+		unsigned __int64 GetPlayedFrames(__int64 * latency_ns);
 
-		inline void SetPlayedTime(const unsigned long long t)
+		inline void SetPlayedFrames(const unsigned __int64 frames)
 		{
-			played = t;
+			played = frames * bytes_per_sample_channel;
 		}
 
 		void SetMatrix ( const speaker_T speaker );
@@ -95,6 +122,13 @@ namespace WinampOpenALOut
 		unsigned int	bits_per_sample;
 		// integer to store the number of buffers we'll use
 		unsigned int	number_of_buffers;
+		// how many of them can be queued at once
+		unsigned int	active_buffers;
+		// the frames asked for in each buffer and the bytes that is
+		unsigned int	chunk_frames;
+		unsigned int	chunk_size;
+		// times the source has run dry while the stream was open
+		unsigned int	underruns;
 		// integer to store bytes per sample (optimisation
 		unsigned int	bytes_per_sample_channel;
 		// integer to store the last pause state
@@ -108,7 +142,9 @@ namespace WinampOpenALOut
 
 		// the open al buffers themselves
 		buffer_type	    buffers[MAX_NO_BUFFERS];
+		// the next buffer to be queued and the oldest one in the queue
 		ALuint			next_buffer_index;
+		ALuint			queue_head;
 		// integer used to reference the open al source
 		ALuint		    source;
 
@@ -0,0 +1,201 @@
+#include "Out_Ring.h"
+
+namespace WinampOpenALOut
+{
+	Output_Ring::Output_Ring()
+	{
+		storage = NULL;
+		storage_size = 0;
+		capacity = 0;
+		block_size = 0;
+		write_index = 0;
+		read_index = 0;
+		used = 0;
+	}
+
+	Output_Ring::~Output_Ring()
+	{
+		if ( storage != NULL )
+		{
+			delete [] storage;
+			storage = NULL;
+		}
+	}
+
+	/*
+		open
+
+		size the ring for a number of blocks, the storage is kept
+		between streams so this only allocates if it has to grow
+	*/
+	bool Output_Ring::Open(
+		const unsigned int a_block_size,
+		const unsigned int a_block_count)
+	{
+		if ( a_block_size == 0 || a_block_count == 0 )
+		{
+			return false;
+		}
+
+		const unsigned int new_capacity = a_block_size * a_block_count;
+
+		if ( new_capacity > storage_size )
+		{
+			if ( storage != NULL )
+			{
+				delete [] storage;
+			}
+
+			storage = new char[new_capacity];
+			storage_size = new_capacity;
+		}
+
+		block_size = a_block_size;
+		capacity = new_capacity;
+
+		Reset();
+
+		return true;
+	}
+
+	void Output_Ring::Close()
+	{
+		Reset();
+		block_size = 0;
+		capacity = 0;
+	}
+
+	/*
+		reset
+
+		throw away anything in the ring, only call this when
+		neither side is using it
+	*/
+	void Output_Ring::Reset()
+	{
+		write_index = 0;
+		read_index = 0;
+		InterlockedExchange(&used, 0);
+	}
+
+	/*
+		write
+
+		copy as much as will fit in to the ring, returns the number
+		of bytes that were taken
+	*/
+	unsigned int Output_Ring::Write(const char *buf, const unsigned int len)
+	{
+		const unsigned int free_space = GetFree();
+		const unsigned int to_write = len < free_space ? len : free_space;
+
+		if ( buf == NULL || to_write == 0 )
+		{
+			return 0;
+		}
+
+		// copy up to the end of the storage and wrap the rest
+		const unsigned int first =
+			to_write < (capacity - write_index) ? to_write : (capacity - write_index);
+
+		memcpy_s(
+			storage + write_index,
+			capacity - write_index,
+			buf,
+			first);
+
+		if ( to_write > first )
+		{
+			memcpy_s(
+				storage,
+				capacity,
+				buf + first,
+				to_write - first);
+		}
+
+		write_index = (write_index + to_write) % capacity;
+
+		// publish the data to the consumer
+		InterlockedExchangeAdd(&used, (LONG)to_write);
+
+		return to_write;
+	}
+
+	/*
+		peek
+
+		get a pointer to the next contiguous run of data, at most one
+		block long. unless (partial) is set nothing is returned until
+		a whole block has been written. the last (held) bytes written
+		are left where they are.
+	*/
+	const char* Output_Ring::Peek(
+		unsigned int *len,
+		const bool partial,
+		const unsigned int held)
+	{
+		const unsigned int used = GetUsed();
+		const unsigned int available = used > held ? used - held : 0;
+
+		*len = 0;
+
+		if ( available == 0 ||
+			(!partial && available < block_size) )
+		{
+			return NULL;
+		}
+
+		unsigned int run = available < block_size ? available : block_size;
+
+		if ( run > capacity - read_index )
+		{
+			run = capacity - read_index;
+		}
+
+		*len = run;
+
+		return storage + read_index;
+	}
+
+	/*
+		get recent
+
+		a pointer to the data that starts (back) bytes before the
+		write position, (len) is how much of it is contiguous. only
+		the producer can use this and only on data the consumer is
+		leaving alone
+	*/
+	char* Output_Ring::GetRecent(const unsigned int back, unsigned int *len)
+	{
+		*len = 0;
+
+		if ( back == 0 || back > GetUsed() )
+		{
+			return NULL;
+		}
+
+		const unsigned int start = (write_index + capacity - back) % capacity;
+		unsigned int run = back;
+
+		if ( run > capacity - start )
+		{
+			run = capacity - start;
+		}
+
+		*len = run;
+
+		return storage + start;
+	}
+
+	/*
+		consume
+
+		release data returned by peek back to the producer
+	*/
+	void Output_Ring::Consume(const unsigned int len)
+	{
+		read_index = (read_index + len) % capacity;
+
+		InterlockedExchangeAdd(&used, -(LONG)len);
+	}
+}
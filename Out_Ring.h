@@ -0,0 +1,68 @@
+#ifndef OUT_RING_H
+#define OUT_RING_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * A single producer, single consumer ring buffer that sits between
+	 * Winamp and the renderers. Data is copied in once by Write and the
+	 * renderers read whole blocks straight out of the storage.
+	 *
+	 * The capacity is always a multiple of the block size so a block
+	 * only ever wraps if a partial block has been consumed.
+	 */
+#ifndef NATIVE
+	public class Output_Ring
+#else
+	class Output_Ring
+#endif
+	{
+	public:
+		Output_Ring();
+		~Output_Ring();
+
+		bool Open(
+			const unsigned int a_block_size,
+			const unsigned int a_block_count);
+		void Close();
+		void Reset();
+
+		unsigned int Write(const char *buf, const unsigned int len);
+
+		const char* Peek(
+			unsigned int *len,
+			const bool partial,
+			const unsigned int held);
+		void Consume(const unsigned int len);
+
+		// the data written most recently, (back) bytes from the end
+		char* GetRecent(const unsigned int back, unsigned int *len);
+
+		inline unsigned int GetUsed()			{ return (unsigned int)used; }
+		inline unsigned int GetFree()			{ return capacity - (unsigned int)used; }
+		inline unsigned int GetBlockSize()		{ return block_size; }
+		inline unsigned int GetCapacity()		{ return capacity; }
+
+	protected:
+
+		// the storage itself, only reallocated if it needs to grow
+		char			*storage;
+		unsigned int	storage_size;
+
+		unsigned int	capacity;
+		unsigned int	block_size;
+
+		// only the producer moves the write index and only
+		// the consumer moves the read index
+		unsigned int	write_index;
+		unsigned int	read_index;
+
+		// bytes in the ring, shared by both sides
+		volatile LONG	used;
+	};
+}
+
+#endif
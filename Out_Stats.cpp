@@ -0,0 +1,206 @@
+#include "Out_Stats.h"
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+namespace WinampOpenALOut
+{
+	LARGE_INTEGER Output_Stats::frequency;
+
+	// the thread currently inside the audio path
+	static volatile DWORD audio_thread = 0;
+	static volatile DWORD audio_worker = 0;
+	static volatile LONG audio_allocations = 0;
+
+#ifdef _DEBUG
+	static _CRT_ALLOC_HOOK previous_hook = NULL;
+
+	static int __cdecl AllocHook(
+		int alloc_type,
+		void *user_data,
+		size_t size,
+		int block_type,
+		long request,
+		const unsigned char *file,
+		int line)
+	{
+		const DWORD current_thread = GetCurrentThreadId();
+
+		if ( alloc_type == _HOOK_ALLOC &&
+			((audio_thread != 0 && audio_thread == current_thread) ||
+			(audio_worker != 0 && audio_worker == current_thread)) )
+		{
+			InterlockedIncrement(&audio_allocations);
+		}
+
+		if ( previous_hook != NULL )
+		{
+			return previous_hook(alloc_type, user_data, size, block_type, request, file, line);
+		}
+		return TRUE;
+	}
+#endif
+
+	Output_Stats::Output_Stats()
+	{
+		if ( frequency.QuadPart == 0 )
+		{
+			QueryPerformanceFrequency(&frequency);
+#ifdef _DEBUG
+			previous_hook = _CrtSetAllocHook(AllocHook);
+#endif
+		}
+
+		write_calls = 0;
+		bytes_in = 0;
+		smallest_write = 0;
+		largest_write = 0;
+		can_write_calls = 0;
+		can_write_held = 0;
+		lock_calls = 0;
+		bytes_copied = 0;
+		bytes_out = 0;
+		underruns = 0;
+		allocations_at_start = 0;
+		start_time = 0.0;
+	}
+
+	double Output_Stats::GetSeconds()
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return (double)now.QuadPart / (double)frequency.QuadPart;
+	}
+
+	void Output_Stats::BeginAudioPath()
+	{
+		audio_thread = GetCurrentThreadId();
+	}
+
+	void Output_Stats::EndAudioPath()
+	{
+		audio_thread = 0;
+	}
+
+	void Output_Stats::SetAudioWorker(const DWORD thread_id)
+	{
+		audio_worker = thread_id;
+	}
+
+	void Output_Stats::Start()
+	{
+		write_calls = 0;
+		bytes_in = 0;
+		smallest_write = 0;
+		largest_write = 0;
+		can_write_calls = 0;
+		can_write_held = 0;
+		lock_calls = 0;
+		bytes_copied = 0;
+		bytes_out = 0;
+		underruns = 0;
+		allocations_at_start = audio_allocations;
+		start_time = GetSeconds();
+	}
+
+	LONG Output_Stats::GetAllocations()
+	{
+		return audio_allocations - allocations_at_start;
+	}
+
+	void Output_Stats::Report(char *msg, const int msg_size)
+	{
+		double elapsed = GetSeconds() - start_time;
+		if ( elapsed <= 0.0 )
+		{
+			elapsed = 1.0;
+		}
+
+		const LONG allocations = GetAllocations();
+
+		sprintf_s(
+			msg,
+			msg_size,
+			"Stats: {%u} writes, {%.0f} bytes/sec in, {%.2f} allocations/sec ({%d} total) over {%.1f}s",
+			write_calls,
+			(double)bytes_in / elapsed,
+			(double)allocations / elapsed,
+			allocations,
+			elapsed);
+	}
+
+	/*
+		on write
+
+		count one Write of (len) bytes
+	*/
+	void Output_Stats::OnWrite(const unsigned int len)
+	{
+		if ( write_calls == 0 || len < smallest_write )
+		{
+			smallest_write = len;
+		}
+		if ( len > largest_write )
+		{
+			largest_write = len;
+		}
+
+		write_calls++;
+		bytes_in += len;
+	}
+
+	/*
+		report writes
+
+		how often winamp calls us and how big its writes are
+	*/
+	void Output_Stats::ReportWrites(char *msg, const int msg_size)
+	{
+		double elapsed = GetSeconds() - start_time;
+		if ( elapsed <= 0.0 )
+		{
+			elapsed = 1.0;
+		}
+
+		const double writes = write_calls > 0 ? (double)write_calls : 1.0;
+
+		sprintf_s(
+			msg,
+			msg_size,
+			"Writes: {%.1f}/sec of {%u}/{%.0f}/{%u} bytes (min/avg/max), {%.1f} CanWrite/sec ({%u} held back), {%.1f} locks/sec",
+			(double)write_calls / elapsed,
+			smallest_write,
+			(double)bytes_in / writes,
+			largest_write,
+			(double)can_write_calls / elapsed,
+			can_write_held,
+			(double)lock_calls / elapsed);
+	}
+
+	/*
+		report pipeline
+
+		memory traffic between the ring and the renderers, per byte
+		that winamp gave us
+	*/
+	void Output_Stats::ReportPipeline(char *msg, const int msg_size)
+	{
+		double elapsed = GetSeconds() - start_time;
+		if ( elapsed <= 0.0 )
+		{
+			elapsed = 1.0;
+		}
+
+		const double in = bytes_in > 0 ? (double)bytes_in : 1.0;
+
+		sprintf_s(
+			msg,
+			msg_size,
+			"Pipeline: {%.0f} bytes/sec copied ({%.2f} per byte in), {%.0f} bytes/sec out ({%.2f} per byte in)",
+			(double)bytes_copied / elapsed,
+			(double)bytes_copied / in,
+			(double)bytes_out / elapsed,
+			(double)bytes_out / in);
+	}
+}
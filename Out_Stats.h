@@ -0,0 +1,76 @@
+#ifndef OUT_STATS_H
+#define OUT_STATS_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * Counters for the audio path of one stream. They're cheap enough
+	 * to always be kept and are written to the debug log on close so
+	 * changes to the audio path can be measured.
+	 */
+#ifndef NATIVE
+	public class Output_Stats
+#else
+	class Output_Stats
+#endif
+	{
+	public:
+		Output_Stats();
+
+		void Start();
+		void OnWrite(const unsigned int len);
+		void Report(char *msg, const int msg_size);
+		void ReportPipeline(char *msg, const int msg_size);
+		void ReportWrites(char *msg, const int msg_size);
+
+		static double GetSeconds();
+
+		LONG GetAllocations();
+
+		/*
+		 * heap allocations are only counted in debug builds, and only
+		 * on the thread that is between Begin/EndAudioPath
+		 */
+		static void BeginAudioPath();
+		static void EndAudioPath();
+
+		// a thread that is always on the audio path (0 for none)
+		static void SetAudioWorker(const DWORD thread_id);
+
+		// calls to Write and bytes given to us by winamp
+		unsigned int		write_calls;
+		unsigned __int64	bytes_in;
+
+		// the smallest and largest single Write
+		unsigned int		smallest_write;
+		unsigned int		largest_write;
+
+		// calls to CanWrite, how many were told to wait for a bigger
+		// batch, and calls from winamp that had to take a lock
+		unsigned int		can_write_calls;
+		unsigned int		can_write_held;
+		unsigned int		lock_calls;
+
+		// bytes written to scratch memory on the way to the renderers
+		// and bytes handed to the renderers (and so to open al)
+		unsigned __int64	bytes_copied;
+		unsigned __int64	bytes_out;
+
+		// times the sources ran dry before winamp ran out of data
+		unsigned int		underruns;
+
+		// heap allocations made on the audio path since Start
+		LONG				allocations_at_start;
+
+	private:
+
+		double				start_time;
+
+		static LARGE_INTEGER frequency;
+	};
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include "Out_Tuner.h"
+#include "Out_Stats.h"
+
+namespace WinampOpenALOut
+{
+	Output_Tuner::Output_Tuner()
+	{
+		minimum_ms = CONF_BUFFER_LENGTH_MIN;
+		maximum_ms = DEFC_BUFFER_LENGTH;
+		queue_ms = DEFC_BUFFER_LENGTH;
+		last_change = 0.0;
+		hold_until = 0.0;
+		last_write = 0.0;
+		interval_ms = 0.0;
+		jitter_ms = 0.0;
+		underrun_pending = FALSE;
+	}
+
+	void Output_Tuner::SetBounds(
+		const unsigned int a_minimum_ms,
+		const unsigned int a_maximum_ms)
+	{
+		minimum_ms = a_minimum_ms;
+		maximum_ms = a_maximum_ms > a_minimum_ms ? a_maximum_ms : a_minimum_ms;
+
+		if ( queue_ms > maximum_ms )
+		{
+			queue_ms = maximum_ms;
+		}
+		if ( queue_ms < minimum_ms )
+		{
+			queue_ms = minimum_ms;
+		}
+	}
+
+	/*
+		start
+
+		called when a stream opens, the queue length carries on from
+		the last stream but the timing of writes starts again
+	*/
+	void Output_Tuner::Start()
+	{
+		const double now = Output_Stats::GetSeconds();
+
+		last_change = now;
+		last_write = 0.0;
+		InterlockedExchange(&underrun_pending, FALSE);
+	}
+
+	void Output_Tuner::OnWrite()
+	{
+		const double now = Output_Stats::GetSeconds();
+
+		if ( last_write > 0.0 )
+		{
+			const double interval = (now - last_write) * ONE_SECOND_IN_MS;
+			double deviation = interval - interval_ms;
+
+			if ( deviation < 0.0 )
+			{
+				deviation = -deviation;
+			}
+
+			interval_ms += (interval - interval_ms) * TUNER_AVERAGE_GAIN;
+			jitter_ms += (deviation - jitter_ms) * TUNER_AVERAGE_GAIN;
+		}
+
+		last_write = now;
+	}
+
+	void Output_Tuner::OnUnderrun()
+	{
+		InterlockedExchange(&underrun_pending, TRUE);
+	}
+
+	bool Output_Tuner::Update()
+	{
+		const double now = Output_Stats::GetSeconds();
+		const unsigned int old_queue_ms = queue_ms;
+
+		if ( InterlockedExchange(&underrun_pending, FALSE) )
+		{
+			// we ran dry, double up and leave it alone for a while
+			queue_ms = queue_ms * 2 < maximum_ms ? queue_ms * 2 : maximum_ms;
+			hold_until = now + TUNER_HOLD_SECONDS;
+			last_change = now;
+		}
+		else if ( now > hold_until &&
+			(now - last_change) * ONE_SECOND_IN_MS > TUNER_INTERVAL_MS )
+		{
+			// clean for a while, try a little less
+			unsigned int floor_ms = 
+				(unsigned int)(interval_ms + (jitter_ms * TUNER_JITTER_FACTOR));
+			if ( floor_ms < minimum_ms )
+			{
+				floor_ms = minimum_ms;
+			}
+
+			const unsigned int shorter_ms = queue_ms - (queue_ms / TUNER_SHRINK_DIVISOR);
+			queue_ms = shorter_ms > floor_ms ? shorter_ms : floor_ms;
+			if ( queue_ms > maximum_ms )
+			{
+				queue_ms = maximum_ms;
+			}
+			last_change = now;
+		}
+
+		return queue_ms != old_queue_ms;
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef OUT_TUNER_H
+#define OUT_TUNER_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * Works out how much audio to keep queued in open al. Every
+	 * underrun makes the queue longer straight away, and while
+	 * playback is clean the queue is slowly shortened, but never
+	 * below what the jitter between Write calls needs. The length is
+	 * kept between streams so each machine settles on its own value.
+	 */
+#ifndef NATIVE
+	public class Output_Tuner
+#else
+	class Output_Tuner
+#endif
+	{
+	public:
+		Output_Tuner();
+
+		void SetBounds(const unsigned int a_minimum_ms, const unsigned int a_maximum_ms);
+		void Start();
+
+		// only ever called from the thread that calls Write
+		void OnWrite();
+		void OnUnderrun();
+
+		/*
+		 * returns true if the queue length has changed since the
+		 * last call
+		 */
+		bool Update();
+
+		inline unsigned int GetQueueLength()	{ return queue_ms; }
+		inline unsigned int GetMaximum()		{ return maximum_ms; }
+		inline double GetJitter()				{ return jitter_ms; }
+
+	protected:
+
+		unsigned int	minimum_ms;
+		unsigned int	maximum_ms;
+		unsigned int	queue_ms;
+
+		// when the queue last changed and when it can next shrink
+		double			last_change;
+		double			hold_until;
+
+		// time between writes, a running average and how far the
+		// writes stray from it
+		double			last_write;
+		double			interval_ms;
+		double			jitter_ms;
+
+		volatile LONG	underrun_pending;
+	};
+}
+
+#endif
@@ -0,0 +1,499 @@
+#include "Out_Upmix.h"
+#include "Out_Dsp.h"
+
+#include <math.h>
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+// the fft is half the frame long, a real fft packed in to a complex one
+#define UPMIX_FFT_SIZE (UPMIX_FRAME_SIZE / 2)
+#define UPMIX_BINS (UPMIX_FFT_SIZE + 1)
+
+// where the inputs' spectra are kept, after the outputs'
+#define UPMIX_LEFT UPMIX_CHANNELS
+#define UPMIX_RIGHT (UPMIX_CHANNELS + 1)
+
+// the output channels, in 5.1 order
+#define UPMIX_FRONT_LEFT 0
+#define UPMIX_FRONT_RIGHT 1
+#define UPMIX_CENTRE 2
+#define UPMIX_LFE 3
+#define UPMIX_BACK_LEFT 4
+#define UPMIX_BACK_RIGHT 5
+
+#define UPMIX_PI 3.14159265358979323846
+#define UPMIX_SQRT2 1.41421356f
+
+// keeps the ratios finite when there's silence
+#define UPMIX_TINY 1.0e-20f
+
+// how much audio Measure runs through
+#define UPMIX_MEASURE_RATE 48000
+#define UPMIX_MEASURE_SECONDS 2
+
+namespace WinampOpenALOut
+{
+	Output_Upmix::Output_Upmix()
+	{
+		sample_rate = 0;
+		lfe_bins = 0;
+		position = 0;
+
+		window = NULL;
+		twiddles = NULL;
+		split_re = NULL;
+		split_im = NULL;
+		work_re = NULL;
+		work_im = NULL;
+		power_left = NULL;
+		power_right = NULL;
+		cross_re = NULL;
+		cross_im = NULL;
+		silence = NULL;
+		silence_size = 0;
+
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS + 2 ; c++ )
+		{
+			spectrum_re[c] = NULL;
+			spectrum_im[c] = NULL;
+		}
+
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS ; c++ )
+		{
+			overlap[c] = NULL;
+			ready[c] = NULL;
+		}
+
+		history[0] = NULL;
+		history[1] = NULL;
+	}
+
+	/*
+		open
+
+		everything is allocated here, nothing is allocated while
+		the audio plays
+	*/
+	bool Output_Upmix::Open(
+		const unsigned int a_sample_rate,
+		const unsigned int frame_size,
+		const unsigned int sample_size)
+	{
+		const unsigned int frame_bytes = UPMIX_FRAME_SIZE * FOUR_BYTE_SAMPLE;
+		const unsigned int bin_bytes = UPMIX_BINS * FOUR_BYTE_SAMPLE;
+		const unsigned int fft_bytes = UPMIX_FFT_SIZE * FOUR_BYTE_SAMPLE;
+		const unsigned int hop_bytes = UPMIX_HOP_SIZE * FOUR_BYTE_SAMPLE;
+
+		silence_size = UPMIX_FRAME_SIZE * frame_size;
+
+		// every allocation can be padded out by up to ARENA_ALIGNMENT
+		const unsigned int allocations = 
+			1 + 1 + 2 + 2 + (UPMIX_CHANNELS * 2) + ((UPMIX_CHANNELS + 2) * 2) + 2 + 4 + 1;
+
+		const unsigned int size =
+			frame_bytes +							// window
+			(fft_bytes * 2) +						// twiddles
+			(bin_bytes * 2) +						// split
+			(frame_bytes * 2) +						// history
+			(frame_bytes * UPMIX_CHANNELS) +		// overlap
+			(hop_bytes * UPMIX_CHANNELS) +			// ready
+			(bin_bytes * (UPMIX_CHANNELS + 2) * 2) +	// spectra
+			(fft_bytes * 2) +						// work
+			(bin_bytes * 4) +						// averages
+			silence_size +
+			(allocations * ARENA_ALIGNMENT);
+
+		if ( !memory.Open(size) )
+		{
+			sample_rate = 0;
+			return false;
+		}
+
+		window = (float*)memory.Allocate(frame_bytes);
+		twiddles = (float*)memory.Allocate(fft_bytes * 2);
+		split_re = (float*)memory.Allocate(bin_bytes);
+		split_im = (float*)memory.Allocate(bin_bytes);
+		history[0] = (float*)memory.Allocate(frame_bytes);
+		history[1] = (float*)memory.Allocate(frame_bytes);
+
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS ; c++ )
+		{
+			overlap[c] = (float*)memory.Allocate(frame_bytes);
+			ready[c] = (float*)memory.Allocate(hop_bytes);
+		}
+
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS + 2 ; c++ )
+		{
+			spectrum_re[c] = (float*)memory.Allocate(bin_bytes);
+			spectrum_im[c] = (float*)memory.Allocate(bin_bytes);
+		}
+
+		work_re = (float*)memory.Allocate(fft_bytes);
+		work_im = (float*)memory.Allocate(fft_bytes);
+		power_left = (float*)memory.Allocate(bin_bytes);
+		power_right = (float*)memory.Allocate(bin_bytes);
+		cross_re = (float*)memory.Allocate(bin_bytes);
+		cross_im = (float*)memory.Allocate(bin_bytes);
+		silence = memory.Allocate(silence_size);
+
+		/*
+		 * the square root of a hann window on the way in and again
+		 * on the way out, overlapped by half they add up to 1
+		 */
+		for ( unsigned int n = 0 ; n < UPMIX_FRAME_SIZE ; n++ )
+		{
+			window[n] = (float)sqrt(0.5 - (0.5 * cos((2.0 * UPMIX_PI * n) / UPMIX_FRAME_SIZE)));
+		}
+
+		Output_Dsp::SetupFft(UPMIX_FFT_SIZE, twiddles);
+
+		for ( unsigned int k = 0 ; k < UPMIX_BINS ; k++ )
+		{
+			const double angle = (-2.0 * UPMIX_PI * k) / UPMIX_FRAME_SIZE;
+			split_re[k] = (float)cos(angle);
+			split_im[k] = (float)sin(angle);
+		}
+
+		// the lfe fades out over the octave above the cutoff
+		sample_rate = a_sample_rate;
+		lfe_bins = ((2 * UPMIX_LFE_CUTOFF_HZ * UPMIX_FRAME_SIZE) / sample_rate) + 1;
+		if ( lfe_bins > UPMIX_BINS )
+		{
+			lfe_bins = UPMIX_BINS;
+		}
+
+		// 8 bit audio is unsigned, silence is the middle not 0
+		memset(silence, sample_size == ONE_BYTE_SAMPLE ? 0x80 : 0, silence_size);
+
+		Reset();
+
+		return true;
+	}
+
+	void Output_Upmix::Close()
+	{
+		memory.Close();
+		sample_rate = 0;
+	}
+
+	void Output_Upmix::Reset()
+	{
+		if ( !IsOpen() )
+		{
+			return;
+		}
+
+		position = 0;
+
+		memset(history[0], 0, UPMIX_FRAME_SIZE * FOUR_BYTE_SAMPLE);
+		memset(history[1], 0, UPMIX_FRAME_SIZE * FOUR_BYTE_SAMPLE);
+
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS ; c++ )
+		{
+			memset(overlap[c], 0, UPMIX_FRAME_SIZE * FOUR_BYTE_SAMPLE);
+			memset(ready[c], 0, UPMIX_HOP_SIZE * FOUR_BYTE_SAMPLE);
+		}
+
+		memset(power_left, 0, UPMIX_BINS * FOUR_BYTE_SAMPLE);
+		memset(power_right, 0, UPMIX_BINS * FOUR_BYTE_SAMPLE);
+		memset(cross_re, 0, UPMIX_BINS * FOUR_BYTE_SAMPLE);
+		memset(cross_im, 0, UPMIX_BINS * FOUR_BYTE_SAMPLE);
+	}
+
+	/*
+		process
+
+		the input goes in to the end of the history and the output
+		comes from the last frame worked out, a frame is worked out
+		every UPMIX_HOP_SIZE frames
+	*/
+	void Output_Upmix::Process(
+		const float *left,
+		const float *right,
+		const unsigned int frames,
+		float **out)
+	{
+		unsigned int done = 0;
+
+		while ( done < frames )
+		{
+			unsigned int count = UPMIX_HOP_SIZE - position;
+			if ( count > frames - done )
+			{
+				count = frames - done;
+			}
+
+			const unsigned int at = UPMIX_FRAME_SIZE - UPMIX_HOP_SIZE + position;
+			const unsigned int bytes = count * FOUR_BYTE_SAMPLE;
+
+			memcpy_s(history[0] + at, bytes, left + done, bytes);
+			memcpy_s(history[1] + at, bytes, right + done, bytes);
+
+			for ( unsigned int c = 0 ; c < UPMIX_CHANNELS ; c++ )
+			{
+				memcpy_s(out[c] + done, bytes, ready[c] + position, bytes);
+			}
+
+			position += count;
+			done += count;
+
+			if ( position == UPMIX_HOP_SIZE )
+			{
+				ProcessFrame();
+				position = 0;
+			}
+		}
+	}
+
+	/*
+		process frame
+
+		for every frequency, how alike the two sides are (coherence)
+		and how evenly they're balanced decide where it goes. sound
+		that's the same on both sides is in the centre, sound that
+		is on both sides but not the same is ambience for the rears.
+		the rears are turned a quarter cycle in opposite directions
+		so they don't sound like the fronts
+	*/
+	void Output_Upmix::ProcessFrame()
+	{
+		Analyse(history[0], spectrum_re[UPMIX_LEFT], spectrum_im[UPMIX_LEFT]);
+		Analyse(history[1], spectrum_re[UPMIX_RIGHT], spectrum_im[UPMIX_RIGHT]);
+
+		const unsigned int kept = (UPMIX_FRAME_SIZE - UPMIX_HOP_SIZE) * FOUR_BYTE_SAMPLE;
+		memmove(history[0], history[0] + UPMIX_HOP_SIZE, kept);
+		memmove(history[1], history[1] + UPMIX_HOP_SIZE, kept);
+
+		const float *left_re = spectrum_re[UPMIX_LEFT];
+		const float *left_im = spectrum_im[UPMIX_LEFT];
+		const float *right_re = spectrum_re[UPMIX_RIGHT];
+		const float *right_im = spectrum_im[UPMIX_RIGHT];
+
+		const float keep = UPMIX_SMOOTHING;
+		const float take = 1.0f - UPMIX_SMOOTHING;
+
+		for ( unsigned int k = 0 ; k < UPMIX_BINS ; k++ )
+		{
+			const float lr = left_re[k];
+			const float li = left_im[k];
+			const float rr = right_re[k];
+			const float ri = right_im[k];
+
+			power_left[k] = (keep * power_left[k]) + (take * ((lr * lr) + (li * li)));
+			power_right[k] = (keep * power_right[k]) + (take * ((rr * rr) + (ri * ri)));
+			cross_re[k] = (keep * cross_re[k]) + (take * ((lr * rr) + (li * ri)));
+			cross_im[k] = (keep * cross_im[k]) + (take * ((li * rr) - (lr * ri)));
+
+			const float cross = sqrtf((cross_re[k] * cross_re[k]) + (cross_im[k] * cross_im[k]));
+			const float both = sqrtf(power_left[k] * power_right[k]);
+
+			float coherence = cross / (both + UPMIX_TINY);
+			if ( coherence > 1.0f )
+			{
+				coherence = 1.0f;
+			}
+
+			// 1 when the sides are as loud as each other, 0 if one is silent
+			const float balance = (2.0f * both) / (power_left[k] + power_right[k] + UPMIX_TINY);
+
+			/*
+			 * averaged over a few frames even unrelated sides look a
+			 * little alike, squaring keeps that out of the centre
+			 */
+			const float alike = coherence * coherence;
+			const float centre = alike * balance;
+			const float ambience = (1.0f - alike) * balance * UPMIX_REAR_LEVEL;
+
+			const float sum_re = 0.5f * (lr + rr);
+			const float sum_im = 0.5f * (li + ri);
+
+			const float front_left_re = lr - (centre * sum_re);
+			const float front_left_im = li - (centre * sum_im);
+			const float front_right_re = rr - (centre * sum_re);
+			const float front_right_im = ri - (centre * sum_im);
+
+			spectrum_re[UPMIX_FRONT_LEFT][k] = front_left_re;
+			spectrum_im[UPMIX_FRONT_LEFT][k] = front_left_im;
+			spectrum_re[UPMIX_FRONT_RIGHT][k] = front_right_re;
+			spectrum_im[UPMIX_FRONT_RIGHT][k] = front_right_im;
+
+			spectrum_re[UPMIX_CENTRE][k] = UPMIX_SQRT2 * centre * sum_re;
+			spectrum_im[UPMIX_CENTRE][k] = UPMIX_SQRT2 * centre * sum_im;
+
+			spectrum_re[UPMIX_BACK_LEFT][k] = -ambience * front_left_im;
+			spectrum_im[UPMIX_BACK_LEFT][k] = ambience * front_left_re;
+			spectrum_re[UPMIX_BACK_RIGHT][k] = ambience * front_right_im;
+			spectrum_im[UPMIX_BACK_RIGHT][k] = -ambience * front_right_re;
+
+			float lfe = 0.0f;
+			if ( k < lfe_bins )
+			{
+				const float frequency = (float)(k * sample_rate) / UPMIX_FRAME_SIZE;
+				lfe = (frequency <= UPMIX_LFE_CUTOFF_HZ) ? 1.0f : 
+					2.0f - (frequency / UPMIX_LFE_CUTOFF_HZ);
+				if ( lfe < 0.0f )
+				{
+					lfe = 0.0f;
+				}
+			}
+
+			spectrum_re[UPMIX_LFE][k] = lfe * sum_re;
+			spectrum_im[UPMIX_LFE][k] = lfe * sum_im;
+		}
+
+		// there's no quarter cycle turn at 0Hz or the very top
+		spectrum_re[UPMIX_BACK_LEFT][0] = 0.0f;
+		spectrum_im[UPMIX_BACK_LEFT][0] = 0.0f;
+		spectrum_re[UPMIX_BACK_RIGHT][0] = 0.0f;
+		spectrum_im[UPMIX_BACK_RIGHT][0] = 0.0f;
+		spectrum_re[UPMIX_BACK_LEFT][UPMIX_FFT_SIZE] = 0.0f;
+		spectrum_im[UPMIX_BACK_LEFT][UPMIX_FFT_SIZE] = 0.0f;
+		spectrum_re[UPMIX_BACK_RIGHT][UPMIX_FFT_SIZE] = 0.0f;
+		spectrum_im[UPMIX_BACK_RIGHT][UPMIX_FFT_SIZE] = 0.0f;
+
+		const unsigned int hop = UPMIX_HOP_SIZE * FOUR_BYTE_SAMPLE;
+
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS ; c++ )
+		{
+			Synthesise(spectrum_re[c], spectrum_im[c], overlap[c]);
+
+			memcpy_s(ready[c], hop, overlap[c], hop);
+			memmove(overlap[c], overlap[c] + UPMIX_HOP_SIZE, kept);
+			memset(overlap[c] + (UPMIX_FRAME_SIZE - UPMIX_HOP_SIZE), 0, hop);
+		}
+	}
+
+	/*
+		analyse
+
+		window a frame and take it to UPMIX_BINS frequencies. the
+		even samples go in the real parts and the odd ones in the
+		imaginary parts of a half size fft, which is then split in
+		to the spectrum of the whole frame
+	*/
+	void Output_Upmix::Analyse(const float *src, float *re, float *im)
+	{
+		for ( unsigned int n = 0 ; n < UPMIX_FFT_SIZE ; n++ )
+		{
+			work_re[n] = src[2 * n] * window[2 * n];
+			work_im[n] = src[(2 * n) + 1] * window[(2 * n) + 1];
+		}
+
+		Output_Dsp::Fft(work_re, work_im, UPMIX_FFT_SIZE, twiddles);
+
+		for ( unsigned int k = 0 ; k < UPMIX_BINS ; k++ )
+		{
+			const unsigned int a = k % UPMIX_FFT_SIZE;
+			const unsigned int b = (UPMIX_FFT_SIZE - k) % UPMIX_FFT_SIZE;
+
+			// the even half and the odd half of the spectrum
+			const float even_re = 0.5f * (work_re[a] + work_re[b]);
+			const float even_im = 0.5f * (work_im[a] - work_im[b]);
+			const float odd_re = 0.5f * (work_im[a] + work_im[b]);
+			const float odd_im = -0.5f * (work_re[a] - work_re[b]);
+
+			re[k] = even_re + ((odd_re * split_re[k]) - (odd_im * split_im[k]));
+			im[k] = even_im + ((odd_re * split_im[k]) + (odd_im * split_re[k]));
+		}
+	}
+
+	/*
+		synthesise
+
+		the opposite of Analyse, then windowed again and added on
+		to what's left of the frames before
+	*/
+	void Output_Upmix::Synthesise(float *re, float *im, float *dst)
+	{
+		for ( unsigned int k = 0 ; k < UPMIX_FFT_SIZE ; k++ )
+		{
+			const unsigned int b = UPMIX_FFT_SIZE - k;
+
+			const float even_re = 0.5f * (re[k] + re[b]);
+			const float even_im = 0.5f * (im[k] - im[b]);
+			const float diff_re = 0.5f * (re[k] - re[b]);
+			const float diff_im = 0.5f * (im[k] + im[b]);
+
+			// turned back the other way
+			const float odd_re = (diff_re * split_re[k]) + (diff_im * split_im[k]);
+			const float odd_im = (diff_im * split_re[k]) - (diff_re * split_im[k]);
+
+			work_re[k] = even_re - odd_im;
+			work_im[k] = even_im + odd_re;
+		}
+
+		Output_Dsp::Fft(work_im, work_re, UPMIX_FFT_SIZE, twiddles);
+
+		const float scale = 1.0f / UPMIX_FFT_SIZE;
+
+		for ( unsigned int n = 0 ; n < UPMIX_FFT_SIZE ; n++ )
+		{
+			dst[2 * n] += work_re[n] * scale * window[2 * n];
+			dst[(2 * n) + 1] += work_im[n] * scale * window[(2 * n) + 1];
+		}
+	}
+
+	/*
+		measure
+
+		a couple of seconds of noise with some of it in common, so
+		every part of the frame is worked out
+	*/
+	double Output_Upmix::Measure()
+	{
+		static float left[UPMIX_HOP_SIZE];
+		static float right[UPMIX_HOP_SIZE];
+		static float planes[UPMIX_CHANNELS][UPMIX_HOP_SIZE];
+
+		float *out[UPMIX_CHANNELS];
+		for ( unsigned int c = 0 ; c < UPMIX_CHANNELS ; c++ )
+		{
+			out[c] = planes[c];
+		}
+
+		unsigned int noise = 1;
+		for ( unsigned int i = 0 ; i < UPMIX_HOP_SIZE ; i++ )
+		{
+			noise = (noise * 1664525u) + 1013904223u;
+			const float common = (float)((int)(noise >> 16) - 32768) / 32768.0f;
+			noise = (noise * 1664525u) + 1013904223u;
+			const float apart = (float)((int)(noise >> 16) - 32768) / 32768.0f;
+
+			left[i] = (0.25f * common) + (0.25f * apart);
+			right[i] = (0.25f * common) - (0.25f * apart);
+		}
+
+		Output_Upmix upmix;
+		if ( !upmix.Open(UPMIX_MEASURE_RATE, TWO_BYTE_SAMPLE * 2, TWO_BYTE_SAMPLE) )
+		{
+			return 0.0;
+		}
+
+		const unsigned int hops = (UPMIX_MEASURE_RATE * UPMIX_MEASURE_SECONDS) / UPMIX_HOP_SIZE;
+
+		LARGE_INTEGER frequency;
+		LARGE_INTEGER start;
+		LARGE_INTEGER end;
+
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&start);
+
+		for ( unsigned int hop = 0 ; hop < hops ; hop++ )
+		{
+			upmix.Process(left, right, UPMIX_HOP_SIZE, out);
+		}
+
+		QueryPerformanceCounter(&end);
+
+		upmix.Close();
+
+		const double seconds = 
+			(double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+		const double played = 
+			((double)hops * UPMIX_HOP_SIZE) / UPMIX_MEASURE_RATE;
+
+		return (seconds * 100.0) / played;
+	}
+}
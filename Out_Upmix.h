@@ -0,0 +1,113 @@
+#ifndef OUT_UPMIX_H
+#define OUT_UPMIX_H
+
+#include "Constants.h"
+#include "Framework\Framework.h"
+#include "Out_Arena.h"
+
+namespace WinampOpenALOut
+{
+	/*
+	 * Stereo to 5.1 in the frequency domain. Each frame of the left
+	 * and right channels is taken through a real fft, and for every
+	 * frequency the parts the two sides share are sent to the centre,
+	 * the parts they don't share to the rears, and the lows to the
+	 * lfe. The frames overlap by half and are added back together,
+	 * so everything comes out UPMIX_FRAME_SIZE frames late.
+	 */
+#ifndef NATIVE
+	public class Output_Upmix
+#else
+	class Output_Upmix
+#endif
+	{
+	public:
+		Output_Upmix();
+
+		/*
+		 * (frame_size) is the size of a frame in the ring and
+		 * (sample_size) the size of one sample in it, the silence
+		 * to push the last frames out is made in that format
+		 */
+		bool Open(
+			const unsigned int a_sample_rate,
+			const unsigned int frame_size,
+			const unsigned int sample_size);
+		void Close();
+
+		// forget everything, for a seek
+		void Reset();
+
+		/*
+		 * (frames) of (left) and (right) in, and the same number of
+		 * frames out to the UPMIX_CHANNELS planes in (out)
+		 */
+		void Process(
+			const float *left,
+			const float *right,
+			const unsigned int frames,
+			float **out);
+
+		inline bool IsOpen()						{ return sample_rate != 0; }
+		inline unsigned int GetLatencyFrames()		{ return IsOpen() ? UPMIX_FRAME_SIZE : 0; }
+
+		/*
+		 * GetLatencyFrames of silence in the ring's format, written
+		 * after the end of the stream it brings out what's held back
+		 */
+		inline const char* GetSilence(unsigned int *len)
+		{
+			*len = silence_size;
+			return silence;
+		}
+
+		/*
+		 * how much of one core it takes to upmix 48kHz audio as it
+		 * plays, in percent
+		 */
+		static double Measure();
+
+	protected:
+
+		void ProcessFrame();
+		void Analyse(const float *src, float *re, float *im);
+		void Synthesise(float *re, float *im, float *overlap);
+
+		Output_Arena	memory;
+
+		unsigned int	sample_rate;
+		unsigned int	lfe_bins;
+
+		// frames into the current hop
+		unsigned int	position;
+
+		// windows, tables for the half size complex fft and for
+		// turning it in to a real one
+		float			*window;
+		float			*twiddles;
+		float			*split_re;
+		float			*split_im;
+
+		// the last frame of input and the overlap of each output
+		float			*history[2];
+		float			*overlap[UPMIX_CHANNELS];
+		float			*ready[UPMIX_CHANNELS];
+
+		// the spectrum of each input and output, and the fft
+		float			*spectrum_re[UPMIX_CHANNELS + 2];
+		float			*spectrum_im[UPMIX_CHANNELS + 2];
+		float			*work_re;
+		float			*work_im;
+
+		// how alike the two sides are, averaged over a few frames
+		float			*power_left;
+		float			*power_right;
+		float			*cross_re;
+		float			*cross_im;
+
+		char			*silence;
+		unsigned int	silence_size;
+	};
+}
+
+#endif
@@ -6,6 +6,10 @@
 #endif
 #include "ConfigFile.h"
 #include "Out_Renderer.h"
+#include "Out_Ring.h"
+#include "Out_Arena.h"
+#include "Out_Dsp.h"
+#include "Out_Matrix.h"
 #include "Winamp.h"
 
 #define DEBUG_BUFFER_SIZE 255
@@ -22,12 +26,8 @@ namespace WinampOpenALOut {
 	Output_Wumpus::Output_Wumpus() {
 
 		// make sure all the pointers are set to zero
-		last_output_time = ZERO_TIME;
-		last_written_time = ZERO_TIME;
 		total_written = ZERO_TIME;
 		total_played = ZERO_TIME;
-		current_output_time = ZERO_TIME;
-		current_written_time = ZERO_TIME;
 		effects = NULL;
 
 		no_renderers = 0;
@@ -39,28 +39,74 @@ namespace WinampOpenALOut {
 		is_playing = false;
 		stream_open = false;
 		pre_buffer = false;
-		pre_buffer_number = 0;
+		prebuffer_ms = DEFC_PREBUFFER_LENGTH;
+		fast_start_ms = DEFC_FAST_START_LENGTH;
+		pre_buffer_target = 0;
+		pre_buffer_frames = 0;
+		restarted = false;
+		ramp_in = false;
+		ramp_start = 0.0;
+		ramp_from = 0.0f;
+		ramp_to = 0.0f;
+		ramp_pause = false;
+		source_gain = 0.0f;
+		write_batching = false;
+		batch_open = false;
+		start_requested = 0.0;
+		gapless = false;
+		lingering = false;
+		track_start_frames = 0;
+		crossfade_ms = 0;
+		fade_bytes = 0;
+		fade_capacity = 0;
+		fade_remaining = 0;
+		fade_position = 0;
+		fade_length = 0;
+		write_space = 0;
+		partial_bytes = 0;
 		xram_detected = false;
 		xram_enabled = false;
+		deferred_updates = false;
 
 		sample_rate = 0;
 		number_of_channels = 0;
 		bits_per_sample = 0;
 		no_buffers = 0;
 		bytes_per_sample_channel = 0;
+		input_bits_per_sample = 0;
+		converting = false;
+		widening = false;
+		float_input = false;
+		input_format = SAMPLE_PCM24;
+		float_bus = false;
+		bus_block_frames = DEFC_BUS_BLOCK_FRAMES;
+		upmix_enabled = false;
+		upmix_tail = 0;
 		last_pause = 0;
 		volume = 0;
 
-		temp_size = 0;
-		memset(
-			temp,
-			0,
-			sizeof(temp));
+		ring = NULL;
+		arena = NULL;
+		plan = BLOCK_PASS_THROUGH;
 
 		conf_buffer_length = 0;
 		is_mono_expanded = false;
 		is_stereo_expanded = false;
 		split_out = false;
+
+		threaded = false;
+		worker_thread = NULL;
+		worker_event = NULL;
+		worker_running = FALSE;
+		draining = FALSE;
+		published_space = 0;
+		published_playing = FALSE;
+
+		chunk_ms = 0;
+		chunk_count = DEFC_LOW_LATENCY_CHUNKS;
+
+		auto_tune = false;
+		last_underruns = 0;
 	}
 
 	Output_Wumpus::~Output_Wumpus()
@@ -83,20 +129,6 @@ namespace WinampOpenALOut {
 		return TRUE;
 	}
 
-	int Output_Wumpus::get_current_output_time(
-		const __int64 the_current_output_time, 
-		const unsigned int sample_rate)
-	{
-		return MulDiv( (int)(the_current_output_time & THIRTY_TWO_BIT_BIT_MASK),ONE_SECOND_IN_MS,sample_rate);
-	}
-
-	int Output_Wumpus::get_current_written_time(
-		const __int64 the_current_written_time,
-		const unsigned int sample_rate)
-	{
-		return MulDiv( (int)(the_current_written_time & THIRTY_TWO_BIT_BIT_MASK),ONE_SECOND_IN_MS,sample_rate);
-	}
-
 	void Output_Wumpus::OnError()
 	{
 		this->Close();
@@ -116,7 +148,8 @@ namespace WinampOpenALOut {
 		SYNC_START;
 
 		/* stop the source so we dont hear anthing else */
-		this->Relocate(device, GetOutputTime(),is_split);
+		UpdatePosition();
+		this->Relocate(device, position.GetOutputTime(), is_split);
 
 		SYNC_END;
 	}
@@ -131,7 +164,7 @@ namespace WinampOpenALOut {
 		// grab some temporary data for where we are now
 		// and the format of the data
 		const unsigned int tempSampleRate = sample_rate;
-		const unsigned int tempBitsPerSample = bits_per_sample;
+		const unsigned int tempBitsPerSample = input_bits_per_sample;
 		const unsigned int tempNumberOfChannels = original_number_of_channels;
 
 		// shut down the thread and wait for it to shutdown
@@ -139,7 +172,8 @@ namespace WinampOpenALOut {
 		const int tempPause = last_pause;
 		const float tempVolume = volume;
 
-		/* stop playing */
+		/* stop playing, the new device can't carry on from the old */
+		InterlockedExchange(&draining, FALSE);
 		this->Close();
 		
 		// only switch devices if we have to
@@ -192,26 +226,335 @@ namespace WinampOpenALOut {
 	{
 		this->is_playing = false;
 
-		HANDLE threads[MAX_RENDERERS];
-		int threadCount = 0;
-		memset(threads,0,sizeof(HANDLE)*MAX_RENDERERS);
+		ALuint sources[MAX_RENDERERS];
+		int source_count = 0;
 
 		/*
-		 * ask all of the renderers if they're playing
+		 * ask all of the renderers if they're playing, the ones
+		 * that need to start are started together
 		 */
 		for ( char rend=0 ; rend < no_renderers ; rend++ )
 		{
 			if ( this->renderers[rend] )
 			{
-				threads[threadCount++] = this->renderers[rend]->CheckPlayState();
+				if ( this->renderers[rend]->CheckPlayState() )
+				{
+					sources[source_count++] = this->renderers[rend]->GetSource();
+				}
 				this->is_playing |= this->renderers[rend]->IsPlaying();
 			}
 		}
 
-		for ( char rend=0 ; rend < threadCount ; rend++ )
+		PlaySources(sources, source_count);
+
+		if ( source_count > 0 && start_requested > 0.0 )
+		{
+#ifdef _DEBUGGING
+			LogStartLatency();
+#endif
+			start_requested = 0.0;
+		}
+
+		CheckTuner();
+		CheckDrift();
+
+		UpdatePosition();
+	}
+
+	/*
+		update position
+
+		work out where the stream is and publish it for GetOutputTime
+		and the status form, only call this holding the lock
+	*/
+	void Output_Wumpus::UpdatePosition()
+	{
+		position_snapshot snapshot;
+
+		snapshot.output_ms = ZERO_TIME;
+		snapshot.written_ms = ZERO_TIME;
+
+		if ( stream_open && no_renderers > 0 && renderers[0] )
+		{
+			/*
+			 * every renderer plays the same frames at the same time,
+			 * so the first one speaks for the stream
+			 */
+			__int64 latency_ns = 0;
+			const unsigned __int64 all_frames = 
+				renderers[0]->GetPlayedFrames(&latency_ns);
+
+			// anything from the track before this one doesn't count
+			const bool track_started = all_frames > track_start_frames;
+			const unsigned __int64 frames = 
+				track_started ? all_frames - track_start_frames : 0;
+
+			total_played = frames * bytes_per_sample_channel;
+
+			// the upmixer holds everything back by a frame
+			if ( upmix.IsOpen() )
+			{
+				latency_ns += ((__int64)upmix.GetLatencyFrames() * ONE_SECOND_IN_MS * 1000000) /
+					sample_rate;
+			}
+
+			snapshot.output_ms = clock.Update(
+				frames,
+				latency_ns,
+				is_playing && !last_pause && track_started);
+
+			/*
+			 * total_written counts the stream after expansion, so
+			 * use the expanded frame size to get back to frames
+			 */
+			const unsigned int frame_size =
+				(bits_per_sample >> SHIFT_BITS_TO_BYTES) * number_of_channels;
+
+			// make sure we only use the first 32bits of the 64bit value
+			snapshot.written_ms = (int)(Output_Clock::FramesToMs(
+				total_written / frame_size,
+				sample_rate) & THIRTY_TWO_BIT_BIT_MASK);
+		}
+
+		snapshot.played_bytes = total_played;
+		snapshot.written_bytes = total_written;
+		snapshot.rate = clock.GetRate();
+		snapshot.running = stream_open && is_playing && !last_pause;
+		snapshot.taken_at = Output_Stats::GetSeconds();
+
+		position.Publish(&snapshot);
+	}
+
+	/*
+		refresh position
+
+		if the audio path hasn't published for a while, and nobody
+		else is using the lock, publish from here so the position
+		is never too far behind
+	*/
+	void Output_Wumpus::RefreshPosition()
+	{
+		if ( position.IsStale() && TryEnterCriticalSection(&critical_section) )
+		{
+			UpdatePosition();
+			LeaveCriticalSection(&critical_section);
+		}
+	}
+
+	/*
+		check drift
+
+		in split mode each speaker has its own source, compare where
+		they all are and nudge the pitch of any that have wandered.
+		it's left alone until all of them are playing
+	*/
+	void Output_Wumpus::CheckDrift()
+	{
+		if ( !split_out || no_renderers < 2 || !is_playing || last_pause )
+		{
+			return;
+		}
+
+		unsigned __int64 frames[MAX_RENDERERS];
+		float pitch[MAX_RENDERERS];
+		__int64 latency_ns = 0;
+
+		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		{
+			if ( renderers[rend] == NULL || !renderers[rend]->IsSourcePlaying() )
+			{
+				return;
+			}
+
+			frames[rend] = renderers[rend]->GetPlayedFrames(&latency_ns);
+		}
+
+		if ( !drift.Update(frames, no_renderers, pitch) )
+		{
+			return;
+		}
+
+		// change them all in the same mixer update
+		if ( deferred_updates )
+		{
+			alDeferUpdatesSOFT();
+		}
+
+		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		{
+			renderers[rend]->SetPitch(pitch[rend]);
+		}
+
+		if ( deferred_updates )
+		{
+			alProcessUpdatesSOFT();
+		}
+	}
+
+#ifdef _DEBUGGING
+	/*
+		log start latency
+
+		how long it took from Open or Flush until the sources were
+		played, and until the first sample should be heard if the
+		driver can tell us how far behind the speakers it is
+	*/
+	void Output_Wumpus::LogStartLatency()
+	{
+		__int64 latency_ns = 0;
+		if ( renderers[0] )
+		{
+			renderers[0]->GetPlayedFrames(&latency_ns);
+		}
+
+		const double play_ms = 
+			(Output_Stats::GetSeconds() - start_requested) * ONE_SECOND_IN_MS;
+
+		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+		sprintf_s(
+			dbg,
+			DEBUG_BUFFER_SIZE,
+			"Start: {%s} took {%.1f} ms to play, {%.1f} ms to first sample, {%I64u} frames prebuffered",
+			restarted ? "Flush" : "Open",
+			play_ms,
+			play_ms + ((double)latency_ns / 1000000.0),
+			pre_buffer_frames);
+		log_debug_msg(dbg, __FILE__, __LINE__);
+	}
+#endif
+
+	/*
+		check tuner
+
+		tell the tuner about any underruns, ones at the end of the
+		track don't count, and pass on any change in queue length
+	*/
+	void Output_Wumpus::CheckTuner()
+	{
+		if ( no_renderers == 0 || renderers[0] == NULL )
+		{
+			return;
+		}
+
+		const unsigned int underruns = renderers[0]->GetUnderruns();
+
+		if ( underruns != last_underruns )
+		{
+			last_underruns = underruns;
+
+			if ( !draining )
+			{
+				stats.underruns++;
+
+				if ( auto_tune )
+				{
+					tuner.OnUnderrun();
+				}
+			}
+		}
+
+		if ( auto_tune && tuner.Update() )
+		{
+			SetQueueLength(tuner.GetQueueLength());
+		}
+	}
+
+	void Output_Wumpus::SetQueueLength(const unsigned int ms)
+	{
+		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		{
+			if ( renderers[rend] )
+			{
+				renderers[rend]->SetQueueLength(ms);
+			}
+		}
+
+#ifdef _DEBUGGING
+		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+		sprintf_s(
+			dbg,
+			DEBUG_BUFFER_SIZE,
+			"-> Queue length {%d} ms, write jitter {%.1f} ms",
+			ms,
+			tuner.GetJitter());
+		log_debug_msg(dbg, __FILE__, __LINE__);
+#endif
+	}
+
+	/*
+		get sources
+
+		fill (sources) with the source of every open renderer,
+		returns how many there are
+	*/
+	int Output_Wumpus::GetSources(ALuint * sources)
+	{
+		int source_count = 0;
+
+		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		{
+			if ( renderers[rend] && renderers[rend]->IsStreamOpen() )
+			{
+				sources[source_count++] = renderers[rend]->GetSource();
+			}
+		}
+
+		return source_count;
+	}
+
+	/*
+		control sources
+
+		play, pause or stop a group of sources with one call so
+		they change state on the same sample. if the driver can
+		defer updates the whole change is applied in one go
+	*/
+	void Output_Wumpus::ControlSources(
+		const source_command command,
+		const ALuint * sources,
+		const int count)
+	{
+		if ( count == 0 )
+		{
+			return;
+		}
+
+		if ( deferred_updates )
+		{
+			alDeferUpdatesSOFT();
+		}
+
+		alGetError();
+
+		switch ( command )
+		{
+		case SOURCES_PLAY:
+			alSourcePlayv(count, sources);
+			break;
+		case SOURCES_PAUSE:
+			alSourcePausev(count, sources);
+			break;
+		case SOURCES_STOP:
+			alSourceStopv(count, sources);
+			break;
+		}
+
+		if ( deferred_updates )
 		{
-			ResumeThread(threads[rend]);
+			alProcessUpdatesSOFT();
 		}
+
+#ifdef _DEBUGGING
+		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+		sprintf_s(
+			dbg,
+			DEBUG_BUFFER_SIZE,
+			"-> Sources command {%d} on {%d} sources, error {%d}",
+			command,
+			count,
+			alGetError());
+		log_debug_msg(dbg, __FILE__, __LINE__);
+#endif
 	}
 
 	/*
@@ -269,10 +612,13 @@ namespace WinampOpenALOut {
 	void Output_Wumpus::Initialise(const HWND window)
 	{
 		InitializeCriticalSection(&critical_section);
+		InitializeCriticalSection(&ring_critical_section);
 
 		SYNC_START;
 
 		effects = new Output_Effects();
+		ring = new Output_Ring();
+		arena = new Output_Arena();
 
 		/*
 		 * empty the speaker matrix (values of where the speakers are)
@@ -294,12 +640,8 @@ namespace WinampOpenALOut {
 		sample_rate = NO_SAMPLE_RATE;
 		bits_per_sample = NO_BITS_PER_SAMPLE;
 		number_of_channels = NO_NUMBER_OF_CHANNELS;
-		current_output_time = ZERO_TIME;
-		current_written_time = ZERO_TIME;
 		total_played = ZERO_TIME;
 		total_written = ZERO_TIME;
-		last_output_time = ZERO_TIME;
-		last_written_time = ZERO_TIME;
 
 		// load the config up
 		ConfigFile::Initialise(window);
@@ -346,6 +688,93 @@ namespace WinampOpenALOut {
 		 *	get the 3D mode (split out) and effects settings
 		 */
 		split_out = ConfigFile::ReadBoolean(CONF_SPLIT);
+		threaded = ConfigFile::ReadBoolean(CONF_THREADED);
+		position.SetExtrapolated(ConfigFile::ReadBoolean(CONF_EXTRAPOLATE));
+		gapless = ConfigFile::ReadBoolean(CONF_GAPLESS);
+		write_batching = ConfigFile::ReadBoolean(CONF_WRITE_BATCH);
+		float_input = ConfigFile::ReadBoolean(CONF_FLOAT_INPUT);
+		float_bus = ConfigFile::ReadBoolean(CONF_FLOAT_BUS);
+		upmix_enabled = ConfigFile::ReadBoolean(CONF_UPMIX);
+
+		/*
+		 *	the bus block is a whole number of vectors
+		 */
+		int bus_frames = ConfigFile::ReadInteger(CONF_BUS_BLOCK_FRAMES);
+		if ( bus_frames < (int)BUS_BLOCK_FRAMES_MIN || bus_frames > (int)BUS_BLOCK_FRAMES_MAX )
+		{
+			bus_frames = DEFC_BUS_BLOCK_FRAMES;
+		}
+		bus_block_frames = bus_frames & ~(BUS_BLOCK_FRAMES_MIN - 1);
+
+		/*
+		 *	crossfading is off unless a length is set
+		 */
+		int crossfade = ConfigFile::ReadInteger(CONF_CROSSFADE);
+		if ( crossfade < 0 || crossfade > (int)CROSSFADE_MAX_MS )
+		{
+			crossfade = 0;
+		}
+		crossfade_ms = crossfade;
+
+		/*
+		 *	low latency mode is off unless the chunk length is set
+		 */
+		int low_latency = ConfigFile::ReadInteger(CONF_LOW_LATENCY);
+		if ( low_latency < (int)LOW_LATENCY_CHUNK_MIN || low_latency > (int)LOW_LATENCY_CHUNK_MAX )
+		{
+			low_latency = 0;
+		}
+		chunk_ms = low_latency;
+
+		int low_latency_chunks = ConfigFile::ReadInteger(CONF_LOW_LATENCY_CHUNKS);
+		if ( low_latency_chunks < (int)MINIMUM_BUFFERS || low_latency_chunks > (int)LOW_LATENCY_CHUNKS_MAX )
+		{
+			low_latency_chunks = DEFC_LOW_LATENCY_CHUNKS;
+		}
+		chunk_count = low_latency_chunks;
+
+		/*
+		 *	how much to queue before playing, from the start and
+		 *	after seeking
+		 */
+		int prebuffer_length = ConfigFile::ReadInteger(CONF_PREBUFFER_LENGTH);
+		if ( prebuffer_length < 0 || prebuffer_length > (int)CONF_BUFFER_LENGTH_MAX )
+		{
+			prebuffer_length = DEFC_PREBUFFER_LENGTH;
+		}
+		prebuffer_ms = prebuffer_length;
+
+		int fast_start_length = ConfigFile::ReadInteger(CONF_FAST_START_LENGTH);
+		if ( fast_start_length < 0 || fast_start_length > prebuffer_length )
+		{
+			fast_start_length = 
+				DEFC_FAST_START_LENGTH < prebuffer_ms ? DEFC_FAST_START_LENGTH : prebuffer_ms;
+		}
+		fast_start_ms = fast_start_length;
+
+		/*
+		 *	auto tuning keeps the queue between the bounds, the
+		 *	configured buffer length is the most it will use. in
+		 *	low latency mode it can go down to the fewest chunks
+		 */
+		auto_tune = ConfigFile::ReadBoolean(CONF_AUTO_TUNE);
+
+		int tune_min = ConfigFile::ReadInteger(CONF_AUTO_TUNE_MIN);
+		int tune_max = ConfigFile::ReadInteger(CONF_AUTO_TUNE_MAX);
+
+		const int tune_floor = chunk_ms > 0 ? 
+			(int)(chunk_ms * MINIMUM_BUFFERS) : (int)CONF_BUFFER_LENGTH_MIN;
+
+		if ( tune_min < tune_floor || tune_min > (int)CONF_BUFFER_LENGTH_MAX )
+		{
+			tune_min = tune_floor;
+		}
+		if ( tune_max < tune_min || tune_max > (int)CONF_BUFFER_LENGTH_MAX )
+		{
+			tune_max = conf_buffer_length;
+		}
+
+		tuner.SetBounds(tune_min, tune_max);
 
 		bool efx_enabled = ConfigFile::ReadBoolean(CONF_EFX_ENABLED);
 		effects_list efx_env = REVERB_PRESET_GENERIC;
@@ -373,14 +802,39 @@ namespace WinampOpenALOut {
 		effects->Enable(efx_enabled);
 		effects->SetCurrentEffect(efx_env);
 
+		/*
+		 *	find out which vectorised routines the cpu can run
+		 */
+		Output_Dsp::Initialise();
+
 #ifdef _DEBUGGING
 		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
 		sprintf_s(
 			dbg,
 			DEBUG_BUFFER_SIZE,
-			"Using Device {%d} with buffer of {%d}",
+			"Using Device {%d} with buffer of {%d}, DSP level {%d}",
 			current_device,
-			conf_buffer_length);
+			conf_buffer_length,
+			Output_Dsp::GetLevel());
+		this->log_debug_msg(dbg, __FILE__, __LINE__);
+
+		for ( int format = SAMPLE_PCM24 ; format <= SAMPLE_FLOAT32 ; format++ )
+		{
+			sprintf_s(
+				dbg,
+				DEBUG_BUFFER_SIZE,
+				"Conversion from format {%d}: {%.0f}M samples/sec to float, {%.0f}M to 16 bit",
+				format,
+				Output_Dsp::MeasureConversion((sample_format)format, true),
+				Output_Dsp::MeasureConversion((sample_format)format, false));
+			this->log_debug_msg(dbg, __FILE__, __LINE__);
+		}
+
+		sprintf_s(
+			dbg,
+			DEBUG_BUFFER_SIZE,
+			"Upmix: {%.2f}%% of a core at 48kHz",
+			Output_Upmix::Measure());
 		this->log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
 
@@ -448,6 +902,11 @@ namespace WinampOpenALOut {
 			setting,
 			'D' - '0');
 
+		if ( threaded )
+		{
+			StartWorker();
+		}
+
 		SYNC_END;
 
 	}
@@ -578,18 +1037,27 @@ namespace WinampOpenALOut {
 	*/
 	void Output_Wumpus::Quit() {
 
+		// the worker takes the lock so it has to go first
+		StopWorker();
+
 		SYNC_START;
 
-		// if a steam is open, close it
-		if(stream_open)
+		// if a steam is open, or the end of one is still playing, close it
+		if(stream_open || lingering)
 		{
 			this->Close();
-			stream_open = false;
+			SetStreamOpen(false);
 		}
 
 		delete effects;
 		effects = NULL;
 
+		delete ring;
+		ring = NULL;
+
+		delete arena;
+		arena = NULL;
+
 		ConfigFile::WriteInteger(CONF_VOLUME, (int)(volume * VOLUME_DIVISOR) );
 
 		// shutdown openal
@@ -598,6 +1066,7 @@ namespace WinampOpenALOut {
 
 		SYNC_END;
 
+		DeleteCriticalSection(&ring_critical_section);
 		DeleteCriticalSection(&critical_section);
 	}
 
@@ -619,11 +1088,21 @@ namespace WinampOpenALOut {
 		SYNC_START;
 
 		/*
-		 * catch the case where someone tried 24-bit or higher
+		 * catch anything we can't convert
 		 */
-		if(bitspersamp > SIXTEEN_BIT_PER_SAMPLE)
+		if(bitspersamp != EIGHT_BIT_PER_SAMPLE &&
+			bitspersamp != SIXTEEN_BIT_PER_SAMPLE &&
+			bitspersamp != TWENTY_FOUR_BIT_PER_SAMPLE &&
+			bitspersamp != THIRTY_TWO_BIT_PER_SAMPLE)
 		{
-			MessageBoxA(NULL, "This Plug-In only supports 8 and 16bit audio, please disable 24bit audio in Winamp", "Whoops", MB_OK);
+			MessageBoxA(NULL, "This Plug-In only supports 8, 16, 24 and 32bit audio", "Whoops", MB_OK);
+			SYNC_END;
+			return -1;
+		}
+
+		if(numchannels < 1 || numchannels > (int)INPUT_MAX_CHANNELS)
+		{
+			MessageBoxA(NULL, "This Plug-In only supports up to 8 channels", "Whoops", MB_OK);
 			SYNC_END;
 			return -1;
 		}
@@ -639,18 +1118,77 @@ namespace WinampOpenALOut {
 		log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
 
+		/*
+		 * the last track is still playing out, carry straight on from
+		 * it if we can, otherwise stop it and start again
+		 */
+		if ( lingering )
+		{
+			lingering = false;
+
+			if ( CanContinue(samplerate, numchannels, bitspersamp) )
+			{
+				Continue();
+
+				SYNC_END;
+				return GetQueueMaximum();
+			}
+
+			ALuint sources[MAX_RENDERERS];
+			ControlSources(SOURCES_STOP, sources, GetSources(sources));
+		}
+
+		// nothing can be written while the format changes
+		SetStreamOpen(false);
+		partial_bytes = 0;
+
 		//record the format of the data we're getting
 		sample_rate = samplerate;
 		number_of_channels = numchannels;
 		bits_per_sample = bitspersamp;
-	
-		// reset the play position back to zero
-		total_written = ZERO_TIME;
-		total_played = ZERO_TIME;
-		last_pause = 0;
+		input_bits_per_sample = bitspersamp;
 
-		temp_size = 0;
-		memset(temp, 0, sizeof(temp));
+		/*
+		 * anything over 16 bit is converted to float, or to 16 bit
+		 * if open al can't play float in this many channels
+		 */
+		converting = (bitspersamp > SIXTEEN_BIT_PER_SAMPLE);
+
+		/*
+		 * open al only has 8 bit formats for more than two channels
+		 * with some devices, otherwise 8 bit is widened to 16 bit
+		 */
+		widening = (bitspersamp == EIGHT_BIT_PER_SAMPLE) &&
+			!Output_Renderer::IsFormatSupported(
+				split_out ? 1 : GetOutputChannels(numchannels), 
+				EIGHT_BIT_PER_SAMPLE);
+
+		if ( widening )
+		{
+			converting = true;
+			bits_per_sample = SIXTEEN_BIT_PER_SAMPLE;
+		}
+		else if ( converting )
+		{
+			if ( bitspersamp == TWENTY_FOUR_BIT_PER_SAMPLE )
+			{
+				input_format = SAMPLE_PCM24;
+			}
+			else
+			{
+				input_format = float_input ? SAMPLE_FLOAT32 : SAMPLE_PCM32;
+			}
+
+			bits_per_sample = CanPlayFloat(GetOutputChannels(numchannels)) ? 
+				THIRTY_TWO_BIT_PER_SAMPLE : SIXTEEN_BIT_PER_SAMPLE;
+
+			Output_Dsp::SeedDither(dither);
+		}
+	
+		// reset the play position back to zero
+		total_written = ZERO_TIME;
+		total_played = ZERO_TIME;
+		last_pause = 0;
 
 		// determine the size of the buffer
 		bytes_per_sample_channel = ((bits_per_sample >> SHIFT_BITS_TO_BYTES)*number_of_channels);
@@ -683,34 +1221,118 @@ namespace WinampOpenALOut {
 			effects->Setup();
 		}
 
+		// the device can change between streams so ask each time
+		deferred_updates = 
+			Framework::getInstance()->ALFWIsDeferredUpdatesSupported() == AL_TRUE;
+		Framework::getInstance()->ALFWIsSourceLatencySupported();
+
 		/* stereo and mono expansion 
 		 *	we need to store the original number of channels
-		 *	incase we need to expand them out and need to work
-		 *	out how much "real" data is in the stream
+		 *	incase we need to expand them out, or mix them to a
+		 *	layout the device has, and need to work out how much
+		 *	"real" data is in the stream
 		 */
 		original_number_of_channels = this->number_of_channels;
-		if ( this->is_stereo_expanded && this->number_of_channels == 2)
+		this->number_of_channels = GetOutputChannels(original_number_of_channels);
+
+		/*
+		 * expansion only copies channels and has plans of its own,
+		 * a matrix from the config or a change of layout has to be
+		 * mixed on the float bus
+		 */
+		float matrix[BUS_MAX_CHANNELS * BUS_MAX_CHANNELS];
+		bool mixing = false;
+
+		const bool upmixing = upmix_enabled && 
+			original_number_of_channels == 2 && 
+			number_of_channels == UPMIX_CHANNELS;
+
+		if ( upmixing )
+		{
+			// only used if the upmixer can't be set up
+			Output_Matrix::Build(original_number_of_channels, number_of_channels, matrix);
+			mixing = true;
+		}
+		else if ( Output_Matrix::Load(original_number_of_channels, number_of_channels, matrix) )
+		{
+			mixing = true;
+		}
+		else if ( (int)number_of_channels == GetExpandedChannels(original_number_of_channels) )
+		{
+			Output_Matrix::BuildRepeat(original_number_of_channels, number_of_channels, matrix);
+		}
+		else
+		{
+			Output_Matrix::Build(original_number_of_channels, number_of_channels, matrix);
+			mixing = true;
+		}
+
+		bool use_bus = false;
+
+		if ( float_bus || mixing )
+		{
+			use_bus = bus.Open(
+				original_number_of_channels,
+				number_of_channels,
+				bits_per_sample >> SHIFT_BITS_TO_BYTES,
+				bus_block_frames);
+
+			if ( !use_bus && mixing )
+			{
+				SYNC_END;
+				return -1;
+			}
+
+			if ( upmixing && upmix.Open(
+				sample_rate, 
+				bytes_per_sample_channel, 
+				bits_per_sample >> SHIFT_BITS_TO_BYTES) )
+			{
+				bus.SetUpmix(&upmix);
+			}
+			else
+			{
+				upmix.Close();
+				bus.SetMatrix(matrix);
+			}
+		}
+		else
 		{
-			this->number_of_channels += 2;
+			upmix.Close();
 		}
-		else if ( this->is_mono_expanded && this->number_of_channels == 1)
+
+		upmix_tail = 0;
+		if ( upmix.IsOpen() )
 		{
-			this->number_of_channels += 3;
+			upmix.GetSilence(&upmix_tail);
 		}
 
+		/*
+		 * in low latency mode the buffers are sized by time, so the
+		 * same number of frames whatever the format
+		 */
+		const unsigned int chunk_frames = 
+			(unsigned int)Output_Clock::MsToFrames(chunk_ms, sample_rate);
+
 		no_renderers = 0;
+		bool renderers_open = true;
+
 		if ( split_out == true )
 		{
-			for ( unsigned char rend=0 ; rend < number_of_channels ; rend++ )
+			for ( unsigned char rend=0 ; rend < number_of_channels && rend < MAX_RENDERERS ; rend++ )
 			{
 				renderers[rend] = new Output_Renderer(
-					conf_buffer_length, 
+					GetQueueMaximum(), 
 					rend, 
 					effects);
 				renderers[rend]->SetXRAMEnabled(use_xram);
+				renderers[rend]->SetChunkFrames(chunk_frames);
 				// if we're splitting out, there will always be '1' channel
 				// because we'll split multiple channels out to many single renderers
-				renderers[rend]->Open(samplerate,1,bitspersamp,0,0);
+				if ( renderers[rend]->Open(samplerate,1,bits_per_sample,0,0) < 0 )
+				{
+					renderers_open = false;
+				}
 				no_renderers++;
 			}
 		}
@@ -721,20 +1343,148 @@ namespace WinampOpenALOut {
 			 * the whole stream
 			 */
 			renderers[0] = new Output_Renderer(
-				conf_buffer_length,
+				GetQueueMaximum(),
 				0,
 				effects);
 			renderers[0]->SetXRAMEnabled(use_xram);
-			renderers[0]->Open(samplerate,this->number_of_channels,bitspersamp,0,0);
+			renderers[0]->SetChunkFrames(chunk_frames);
+			if ( renderers[0]->Open(samplerate,this->number_of_channels,bits_per_sample,0,0) < 0 )
+			{
+				renderers_open = false;
+			}
 			no_renderers++;
 		}
 
+		/*
+		 * the device has no format for this layout, there's nothing
+		 * the renderers could play so give up on the stream
+		 */
+		if ( !renderers_open )
+		{
+			for ( char rend=0 ; rend < MAX_RENDERERS ; rend++ )
+			{
+				if ( renderers[rend] )
+				{
+					renderers[rend]->Close();
+					delete renderers[rend];
+					renderers[rend] = NULL;
+				}
+			}
+			no_renderers = 0;
+
+			upmix.Close();
+			bus.Close();
+
+			SYNC_END;
+			return -1;
+		}
+
+		/*
+		 * work out how blocks get from the ring to the renderers
+		 */
+		const bool expanded = (number_of_channels != original_number_of_channels);
+
+		if ( split_out == true )
+		{
+			if ( expanded && original_number_of_channels == 1 )
+			{
+				plan = BLOCK_EXPAND_MONO_SPLIT;
+			}
+			else if ( expanded )
+			{
+				plan = BLOCK_EXPAND_STEREO_SPLIT;
+			}
+			else
+			{
+				plan = BLOCK_SPLIT;
+			}
+		}
+		else
+		{
+			plan = expanded ? BLOCK_EXPAND : BLOCK_PASS_THROUGH;
+		}
+
+		if ( use_bus )
+		{
+			plan = BLOCK_BUS;
+		}
+
+		/*
+		 * size the blocks in the ring so that every renderer gets one
+		 * full open al buffer out of each block, so writes are only
+		 * gathered up until there's a buffer's worth
+		 */
+		const unsigned int renderer_frame_size =
+			(bits_per_sample >> SHIFT_BITS_TO_BYTES) * (split_out ? 1 : number_of_channels);
+		const unsigned int chunk_size = renderers[0]->GetChunkSize();
+		const unsigned int block_size =
+			(chunk_size / renderer_frame_size) * bytes_per_sample_channel;
+
+#ifdef _DEBUG
+		_ASSERTE( block_size > 0 );
+#endif
+
+		/*
+		 * the fade has to fit in the queue with enough left over to
+		 * hand over to the next track, the ring gets extra blocks to
+		 * hold it back in
+		 */
+		const unsigned int queue_ms = GetQueueMaximum();
+		unsigned int fade_ms = crossfade_ms;
+
+		if ( queue_ms <= GAPLESS_HANDOVER_MS )
+		{
+			fade_ms = 0;
+		}
+		else if ( fade_ms > queue_ms - GAPLESS_HANDOVER_MS )
+		{
+			fade_ms = queue_ms - GAPLESS_HANDOVER_MS;
+		}
+
+		fade_bytes = (unsigned int)Output_Clock::MsToFrames(fade_ms, sample_rate) *
+			bytes_per_sample_channel;
+		fade_capacity = fade_bytes;
+		fade_remaining = 0;
+
+		/*
+		 * small low latency queues can be less than one of winamp's
+		 * writes, the ring always has room for one on top so winamp
+		 * isn't left waiting for space that never comes
+		 */
+		const unsigned int input_frame_size =
+			(input_bits_per_sample >> SHIFT_BITS_TO_BYTES) * original_number_of_channels;
+		write_space = ((MAXIMUM_WINAMP_WRITE + input_frame_size - 1) / input_frame_size) *
+			bytes_per_sample_channel;
+
+		unsigned int ring_blocks = (write_space + block_size - 1) / block_size;
+		if ( ring_blocks < RING_BUFFER_BLOCKS )
+		{
+			ring_blocks = RING_BUFFER_BLOCKS;
+		}
+
+		EnterCriticalSection(&ring_critical_section);
+		ring->Open(
+			block_size, 
+			ring_blocks + ((fade_bytes + block_size - 1) / block_size));
+		LeaveCriticalSection(&ring_critical_section);
+
+		/*
+		 * open al copies the data when it's buffered so the scratch
+		 * memory only has to cover one block on its way through,
+		 * at most one open al buffer for each renderer
+		 */
+		arena->Open(
+			(chunk_size * no_renderers) + 
+			(ARENA_ALIGNMENT * MAX_RENDERERS));
+
 #ifdef _DEBUGGING
 		sprintf_s(
 			dbg,
 			DEBUG_BUFFER_SIZE,
-			"-> Using {%d} renderers", 
-			no_renderers);
+			"-> Using {%d} renderers, blocks of {%d} bytes, plan {%d}", 
+			no_renderers,
+			block_size,
+			plan);
 		this->log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
 
@@ -746,19 +1496,47 @@ namespace WinampOpenALOut {
 
 		// we're not playing yet because we're prebuffering
 		is_playing = false;
-		// the stream is open and ready for the main thread
-		stream_open = true;
+		track_start_frames = 0;
+
 		// start prebuffering
 		pre_buffer = true;
+		pre_buffer_frames = 0;
+		pre_buffer_target = Output_Clock::MsToFrames(prebuffer_ms, sample_rate);
 
-		pre_buffer_number = NO_BUFFERS_PROCESSED;
+		start_requested = Output_Stats::GetSeconds();
+		restarted = false;
+		ramp_in = false;
+		ramp_start = 0.0;
+		batch_open = false;
 
 		// reload the speaker positions
 		SetMatrix(speaker_matrix);
 
+		stats.Start();
+		clock.Start(sample_rate, ZERO_TIME);
+		drift.Start(sample_rate);
+
+		/*
+		 * the renderers have buffers for the longest queue the tuner
+		 * can ask for, start them at the length it last settled on
+		 */
+		last_underruns = 0;
+		if ( auto_tune )
+		{
+			tuner.Start();
+			SetQueueLength(tuner.GetQueueLength());
+		}
+
+		// the stream is open and ready for the main thread
+		SetStreamOpen(true);
+
+		InterlockedExchange(&draining, FALSE);
+		UpdatePosition();
+		PublishState();
+
 		SYNC_END;
 
-		return conf_buffer_length;
+		return GetQueueMaximum();
 	}
 
 	/*
@@ -769,7 +1547,105 @@ namespace WinampOpenALOut {
 	void Output_Wumpus::Close() 
 	{
 		SYNC_START;
-		stream_open = false;
+
+#ifdef _DEBUGGING
+		const double close_start = Output_Stats::GetSeconds();
+		const bool was_open = stream_open;
+#endif
+
+#ifdef _DEBUGGING
+		if ( stream_open )
+		{
+			char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+			stats.Report(dbg, DEBUG_BUFFER_SIZE);
+			log_debug_msg(dbg, __FILE__, __LINE__);
+
+			stats.ReportPipeline(dbg, DEBUG_BUFFER_SIZE);
+			log_debug_msg(dbg, __FILE__, __LINE__);
+
+			stats.ReportWrites(dbg, DEBUG_BUFFER_SIZE);
+			log_debug_msg(dbg, __FILE__, __LINE__);
+
+			sprintf_s(
+				dbg,
+				DEBUG_BUFFER_SIZE,
+				"Underruns {%d}, queue length {%d} ms (auto tune {%d})",
+				stats.underruns,
+				auto_tune ? tuner.GetQueueLength() : GetQueueMaximum(),
+				auto_tune);
+			log_debug_msg(dbg, __FILE__, __LINE__);
+
+			if ( split_out )
+			{
+				sprintf_s(
+					dbg,
+					DEBUG_BUFFER_SIZE,
+					"Drift: skew {%.3f} ms, worst {%.3f} ms, {%u} corrections",
+					drift.GetSkewMs(),
+					drift.GetMaximumSkewMs(),
+					drift.GetCorrections());
+				log_debug_msg(dbg, __FILE__, __LINE__);
+			}
+
+			sprintf_s(
+				dbg,
+				DEBUG_BUFFER_SIZE,
+				"Scratch memory used {%d} of {%d} bytes", 
+				arena->GetHighWater(),
+				arena->GetCapacity());
+			log_debug_msg(dbg, __FILE__, __LINE__);
+		}
+#endif
+
+#ifdef _DEBUG
+		// nothing between open and close should have touched the heap
+		_ASSERTE( !stream_open || stats.GetAllocations() == 0 );
+#endif
+
+		/*
+		 * in gapless mode, if winamp has given us the whole track
+		 * leave what's queued playing for the next one to follow,
+		 * when crossfading the end of the track waits in the ring
+		 */
+		if ( (gapless || fade_bytes > 0) && stream_open && draining && is_playing && 
+			ring->GetUsed() <= GetHeldBytes() )
+		{
+			/*
+			 * nothing is going to fade in over the end of this
+			 * track so let it play out
+			 */
+			if ( (fade_bytes > 0 || upmix_tail > 0) && !Winamp::HasNextTrack() )
+			{
+				fade_bytes = 0;
+				SubmitBlocks(true);
+				SubmitUpmixTail();
+			}
+
+			SetStreamOpen(false);
+			lingering = true;
+
+			UpdatePosition();
+			PublishState();
+
+			SYNC_END;
+			return;
+		}
+
+		SetStreamOpen(false);
+		lingering = false;
+		track_start_frames = 0;
+		fade_remaining = 0;
+		partial_bytes = 0;
+		ramp_in = false;
+		ramp_start = 0.0;
+
+		/*
+		 * stop every source in one go so they all stop on the same
+		 * sample, the renderers then reclaim their buffers without
+		 * waiting
+		 */
+		ALuint sources[MAX_RENDERERS];
+		ControlSources(SOURCES_STOP, sources, GetSources(sources));
 
 		/*
 		 * loop through each renderer we're using and close each one down,
@@ -801,15 +1677,42 @@ namespace WinampOpenALOut {
 		sample_rate = NO_SAMPLE_RATE;
 		bits_per_sample = NO_BITS_PER_SAMPLE;
 		number_of_channels = NO_NUMBER_OF_CHANNELS;
-		current_output_time = ZERO_TIME;
-		current_written_time = ZERO_TIME;
 		total_played = ZERO_TIME;
 		total_written = ZERO_TIME;
-		last_output_time = ZERO_TIME;
-		last_written_time = ZERO_TIME;
-		
-		temp_size = 0;
-		memset(temp, 0, sizeof(temp));
+
+		if ( ring )
+		{
+			EnterCriticalSection(&ring_critical_section);
+			ring->Close();
+			LeaveCriticalSection(&ring_critical_section);
+		}
+
+		if ( arena )
+		{
+			arena->Close();
+		}
+
+		bus.Close();
+		upmix.Close();
+		upmix_tail = 0;
+
+		clock.Stop();
+
+		UpdatePosition();
+		PublishState();
+
+#ifdef _DEBUGGING
+		if ( was_open )
+		{
+			char close_dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+			sprintf_s(
+				close_dbg,
+				DEBUG_BUFFER_SIZE,
+				"Close took {%.3f} ms",
+				(Output_Stats::GetSeconds() - close_start) * 1000.0);
+			log_debug_msg(close_dbg, __FILE__, __LINE__);
+		}
+#endif
 
 		SYNC_END;
 
@@ -819,14 +1722,59 @@ namespace WinampOpenALOut {
 		write
 
 		this procedure is invoked by winamp when it attempts to write
-		data to the plugin
+		data to the plugin. returns 1 if there wasn't room for it,
+		winamp then tries the same write again later
 	*/
 	int Output_Wumpus::Write(char *buf, int len)
 	{
+		int result = 0;
+
+		/*
+		 * in threaded mode the ring is all we touch, the worker
+		 * thread is the only consumer and does the open al work
+		 */
+		if ( threaded )
+		{
+			/*
+			 * the ring lock only keeps Open and Close from changing
+			 * the ring under us, the worker never takes it
+			 */
+			EnterCriticalSection(&ring_critical_section);
+
+			stats.lock_calls++;
+
+			if ( buf && stream_open )
+			{
+				stats.OnWrite(len);
+
+				if ( auto_tune )
+				{
+					tuner.OnWrite();
+				}
+
+				// winamp writes it again if it didn't fit
+				if ( WriteInput(buf, len) != (unsigned int)len )
+				{
+					result = 1;
+				}
+
+				InterlockedExchange(&draining, FALSE);
+				SetEvent(worker_event);
+			}
+
+			LeaveCriticalSection(&ring_critical_section);
+
+			return result;
+		}
+
 		SYNC_START;
 
+		stats.lock_calls++;
+
+		Output_Stats::BeginAudioPath();
+
 		// if the buffer is valid (non-NULL)
-		if (buf) {
+		if (buf && stream_open) {
 
 #ifdef _DEBUGGING
 			char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
@@ -838,474 +1786,1163 @@ namespace WinampOpenALOut {
 			log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
 
+			stats.OnWrite(len);
+
+			if ( auto_tune )
+			{
+				tuner.OnWrite();
+			}
+
+			AdvanceRamp();
+
+			InterlockedExchange(&draining, FALSE);
+
 			/*
-			 * if our internal buffer isn't full, copy the new data
-			 * to the internal buffer and quit out
+			 * copy the data in to the ring, this is the only copy we
+			 * make of it before open al takes it
 			 */
-			if ( len + temp_size < MINIMUM_BUFFER_SIZE ) 
-			{
-				memcpy_s(
-					temp + temp_size, 
-					sizeof(temp),
-					buf,
-					len);
+			const unsigned int taken = WriteInput(buf, len);
 
-				temp_size = temp_size + len;
+			// winamp writes it again if it didn't fit
+			if ( taken != (unsigned int)len )
+			{
+				result = 1;
 #ifdef _DEBUGGING
 				sprintf_s(
 					dbg,
 					DEBUG_BUFFER_SIZE,
-					"Temp buffer increased by {%d} to {%d}",len, temp_size);
+					"!! Ring full, {%d} bytes to be written again", len);
 				log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
-				SYNC_END;
-				return 0;
 			}
 
-			char * to_write = NULL;
+			/*
+			 * give every whole block we have to the renderers
+			 */
+			SubmitBlocks(false);
+		}
 
-			if ( temp_size > 0 )
-			{
-				const unsigned int to_write_size = len + temp_size;
-				to_write = new char[to_write_size];
+		Output_Stats::EndAudioPath();
 
-#ifdef _DEBUGGING
-				/* this isnt required, all the data *should* be over-written */
-				memset(to_write, 0x00, to_write_size);
-#endif
+		SYNC_END;
 
-				/* copy the first buffer in */
-				memcpy_s(
-					to_write,
-					to_write_size,
-					temp,
-					temp_size);
-#ifdef _DEBUGGING
-				sprintf_s(
-					dbg,
-					DEBUG_BUFFER_SIZE,
-					"Copying {%d} bytes from temp", temp_size);
-				log_debug_msg(dbg, __FILE__, __LINE__);
-#endif
-				/* copy what we can of the second */
-				void * add_write = to_write + temp_size;
-				const size_t add_write_size = to_write_size - temp_size; 
-				memcpy_s(
-					add_write,
-					add_write_size,
-					buf,
-					len);
+		return result;
+	}
 
-				buf = to_write;
-				len += temp_size;
-				temp_size = 0; 
-				memset(temp, 0, sizeof(temp));
-			}
+	/*
+		submit blocks
 
-			// ############## MONO EXPANSION
-			if(is_mono_expanded && original_number_of_channels == 1)
-			{
-				ExpandMonoToQuad( &buf, &len);
-			}
-			// ############## STEREO EXPANSION
-			if(is_stereo_expanded && original_number_of_channels == 2)
-			{
-				ExpandStereoToQuad( &buf, &len);	
-			}
+		take blocks out of the ring for as long as the renderers
+		have buffers free, (partial) also sends any data left over
+		that doesn't make up a whole block
+	*/
+	void Output_Wumpus::SubmitBlocks(const bool partial)
+	{
+		unsigned int len = 0;
+		const char * block = NULL;
 
-			total_written += len;
+		while ( CanSubmitBlock() && 
+			(block = ring->Peek(&len, partial, GetHeldBytes())) != NULL )
+		{
+			WriteBlock(block, len);
+			ring->Consume(len);
+		}
 
-			if ( split_out == true )
-			{
-				SplitAudioToMonoChannels(buf, len);
-			}
-			else
-			{
-				/* if we're not splitting out, throw it to the renderers */
-				for ( char rend=0; rend < no_renderers ; rend++ )
-				{				
-					renderers[rend]->Write(buf,len);
-				}
-			}
+		// without gapless or a fade nothing is going to follow on
+		if ( partial && draining && upmix_tail > 0 && !gapless && fade_bytes == 0 )
+		{
+			SubmitUpmixTail();
+		}
+	}
 
-			/* now that there is data in the buffers check the play
-			state. if nothing is playing then either a buffer under-run
-			has occured or this is the first time the file has been written.
-			it could also be a small file that the monitor thread might not see
-			*/
-			if(!pre_buffer)
-			{
-				this->CheckPlayState();
-			}
+	/*
+		submit upmix tail
 
-			/*
-			 * check the pre-buffer limit
-			 */
-			if(pre_buffer)
-			{
-				if(++pre_buffer_number == PREBUFFER_LIMIT)
-				{
-					pre_buffer = false;
-				}
-			}
-		}
+		the upmixer is a frame behind, once the ring is empty at the
+		end of the stream silence pushes the last frame out of it
+	*/
+	void Output_Wumpus::SubmitUpmixTail()
+	{
+		unsigned int len = 0;
+		const char * silence = upmix.GetSilence(&len);
+		const unsigned int block_size = ring->GetBlockSize();
 
-		SYNC_END;
+		while ( upmix_tail > 0 && ring->GetUsed() == 0 && CanSubmitBlock() )
+		{
+			const unsigned int piece = upmix_tail < block_size ? upmix_tail : block_size;
 
-		return 0;
+			WriteBlock(silence + (len - upmix_tail), piece);
+			upmix_tail -= piece;
+		}
 	}
 
-	void Output_Wumpus::ExpandMonoToQuad(char ** pbuf, int * plen)
+	/*
+		get held bytes
+
+		how much of the end of the ring has to stay where it is,
+		either the end of the last track waiting to be mixed or the
+		end of this one in case the next track fades in over it
+	*/
+	unsigned int Output_Wumpus::GetHeldBytes()
 	{
-		int len = *plen;
-		char * buf = *pbuf;
+		if ( fade_bytes == 0 )
+		{
+			return 0;
+		}
+
+		const LONG remaining = fade_remaining;
+		if ( remaining > 0 )
+		{
+			return (unsigned int)remaining;
+		}
 
-		// we're writing out four as much data so
-		// increase this value by three more times
-		const unsigned int new_len = (len*4);
+		const unsigned int used = ring->GetUsed();
+		return used < fade_bytes ? used : fade_bytes;
+	}
 
-		// expand buffer here
-		char* new_buffer = new char[new_len];
-#ifdef _DEBUGGING
-		memset(new_buffer, 0, new_len);
-#endif
+	/*
+		write to ring
 
-		// set relative value to zero
-		int nPos = 0;
+		copy winamp's data in to the ring, mixing the start of it
+		over the end of the last track first if we're fading. the
+		tail is mixed in place so the fade costs no extra copies
+	*/
+	unsigned int Output_Wumpus::WriteToRing(const char * buf, const unsigned int len)
+	{
+		unsigned int mixed = 0;
 
-		const unsigned char sample_size = 
-			((bits_per_sample == 8) ? ONE_BYTE_SAMPLE : TWO_BYTE_SAMPLE);
-		
-		/* expand the samples out */
-		for(int pos=0; pos < len; pos++) {
+		const unsigned int frame_size = bytes_per_sample_channel;
 
-			if ( sample_size == ONE_BYTE_SAMPLE)
+		while ( fade_remaining > 0 && frame_size > 0 && (len - mixed) >= frame_size )
+		{
+			unsigned int run = 0;
+			char *tail = ring->GetRecent((unsigned int)fade_remaining, &run);
+
+			if ( tail == NULL )
 			{
-				new_buffer[nPos++] = buf[pos];
-				new_buffer[nPos++] = buf[pos];
-				new_buffer[nPos++] = buf[pos];
-				new_buffer[nPos++] = buf[pos];
+				InterlockedExchange(&fade_remaining, 0);
+				break;
 			}
-			else
+
+			if ( run > len - mixed )
 			{
-				const short* src = (short*)(buf + pos);
-				short* dst_a = (short*)(new_buffer + nPos);
-				short* dst_b = (short*)(new_buffer + nPos + TWO_BYTE_SAMPLE);
-				short* dst_c = (short*)(new_buffer + nPos + (TWO_BYTE_SAMPLE * 2));
-				short* dst_d = (short*)(new_buffer + nPos + (TWO_BYTE_SAMPLE * 4));
-
-				(*dst_a) = (*src);
-				(*dst_b) = (*src);
-				(*dst_c) = (*src);
-				(*dst_d) = (*src);
-
-				nPos += (sample_size * 4);
-				pos += sample_size;
+				run = len - mixed;
+			}
+
+			const unsigned int frames = run / frame_size;
+			if ( frames == 0 )
+			{
+				break;
 			}
-		}
 
-		delete buf;
-		buf = new_buffer;
-		len = new_len;
+			Output_Dsp::CrossFade(
+				tail,
+				buf + mixed,
+				frames,
+				original_number_of_channels,
+				bits_per_sample >> SHIFT_BITS_TO_BYTES,
+				fade_position,
+				fade_length);
 
-		*plen = len;
-		*pbuf = buf;
+			fade_position += frames;
+			mixed += frames * frame_size;
+
+			// only let go of the tail once it's been mixed
+			InterlockedExchangeAdd(&fade_remaining, -(LONG)(frames * frame_size));
+		}
+
+		return mixed + ring->Write(buf + mixed, len - mixed);
 	}
 
-	void Output_Wumpus::ExpandStereoToQuad(char ** pbuf, int * plen)
+	/*
+		write input
+
+		put winamp's data in the ring. the whole write is taken or
+		none of it is, so nothing is lost if the ring is full. only
+		whole frames go in to the ring, part of a frame at the end
+		is kept until the next write finishes it. returns how many
+		of winamp's bytes were taken
+	*/
+	unsigned int Output_Wumpus::WriteInput(const char * buf, const unsigned int len)
 	{
-		int len = *plen;
-		char * buf = *pbuf;
+		const unsigned int input_frame_size = 
+			(input_bits_per_sample >> SHIFT_BITS_TO_BYTES) * original_number_of_channels;
 
-		// we're writing out twice as much data so
-		// increase this value again
-		const unsigned int old_length = len;
-		const unsigned int new_len = old_length * 2;
+		const unsigned int frames = (partial_bytes + len) / input_frame_size;
+		const unsigned int needed = frames * 
+			(converting ? bytes_per_sample_channel : input_frame_size);
 
-		// expand buffer here
-		char* new_buffer = new char[new_len];
-		const unsigned char sample_size = 
-			((bits_per_sample == 8) ? TWO_BYTE_SAMPLE : FOUR_BYTE_SAMPLE);
-		
-		/* expand the samples out */
-		int new_pos = 0;
-		for(unsigned int pos=0; pos < old_length; )
+		if ( needed > ring->GetFree() )
+		{
+			return 0;
+		}
+
+		unsigned int used = 0;
+
+		// finish the frame the last write started
+		if ( partial_bytes > 0 )
 		{
-			if ( sample_size == TWO_BYTE_SAMPLE )
+			used = input_frame_size - partial_bytes;
+			if ( used > len )
 			{
-				short* dst = (short*)(new_buffer + new_pos);
-				const short* src = (const short*)(buf + pos);
-				*dst++ = *src;
-				*dst = *src;
+				used = len;
 			}
-			else
+
+			memcpy_s(partial_frame + partial_bytes, INPUT_MAX_FRAME_SIZE - partial_bytes, buf, used);
+			partial_bytes += used;
+
+			if ( partial_bytes < input_frame_size )
 			{
-				int* dst = (int*)(new_buffer + new_pos);
-				const int* src = (const int*)(buf + pos);
-				*dst++ = *src;
-				*dst = *src;
+				return len;
 			}
 
-			new_pos += (sample_size * 2);
-			pos += sample_size;
+			WriteFrames(partial_frame, input_frame_size);
+			partial_bytes = 0;
 		}
 
-		delete buf;
-		len = new_len;
-		buf = new_buffer;
+		const unsigned int whole = ((len - used) / input_frame_size) * input_frame_size;
+		WriteFrames(buf + used, whole);
+		used += whole;
+
+		// keep the start of the next frame
+		partial_bytes = len - used;
+		if ( partial_bytes > 0 )
+		{
+			memcpy_s(partial_frame, INPUT_MAX_FRAME_SIZE, buf + used, partial_bytes);
+		}
 
-		*plen = len;
-		*pbuf = buf;
+		return len;
 	}
 
-	void Output_Wumpus::SplitAudioToMonoChannels(const char * buf, const int len)
+	/*
+		write frames
+
+		put (len) bytes of whole frames in the ring, converting them
+		a piece at a time first if they aren't in the format the
+		renderers take. WriteInput has already made sure there's
+		room, returns how many of winamp's bytes went in
+	*/
+	unsigned int Output_Wumpus::WriteFrames(const char * buf, const unsigned int len)
 	{
-		// create a table of pointers to each channels buffer
-		char* buffers[MAX_RENDERERS];
-		memset(buffers,0, sizeof(char*) * MAX_RENDERERS);
-		const unsigned int renderer_size = len / no_renderers;
+		if ( !converting )
+		{
+			return WriteToRing(buf, len);
+		}
+
+		const unsigned int input_frame_size = 
+			(input_bits_per_sample >> SHIFT_BITS_TO_BYTES) * original_number_of_channels;
+
+		const unsigned int piece_frames = CONVERT_BUFFER_SIZE / bytes_per_sample_channel;
 
-		if ( bits_per_sample == EIGHT_BIT_PER_SAMPLE )
+		unsigned int taken = 0;
+
+		while ( len - taken >= input_frame_size )
 		{
-			/*
-			 * create a new buffer for each renderer
-			 */
-			for ( char rend=0; rend < no_renderers ; rend++ )
+			unsigned int frames = (len - taken) / input_frame_size;
+			if ( frames > piece_frames )
 			{
-				buffers[rend] = new char[renderer_size];
-				memset(buffers[rend],0, renderer_size);
+				frames = piece_frames;
 			}
-			/*
-			 * treat each sample of the source as an array - one item for each channel.
-			 * treat each sample of the destination as a pointer and add the sample
-			 * index to it and copy the source to it.
-			 */
-			const char* src = (const char*)buf;
-			for ( unsigned int sample = 0 ; sample < renderer_size ; sample++ )
+
+			const unsigned int samples = frames * original_number_of_channels;
+
+			if ( widening )
 			{
-				for ( unsigned char rend=0; rend < no_renderers ; rend++ )
-				{
-					char* dst = (char*)buffers[rend];
-					*(char*)(dst + sample) = (src[rend]);
-				}
-				src += number_of_channels;
+				Output_Dsp::Widen8To16((const unsigned char*)buf + taken, samples, (short*)convert_buffer);
 			}
-		} else {
-			/*
-			 * create a new buffer for each renderer
-			 */
-			for ( char rend=0; rend < no_renderers ; rend++ )
+			else if ( bits_per_sample == THIRTY_TWO_BIT_PER_SAMPLE )
 			{
-				buffers[rend] = new char[renderer_size];
-				memset(buffers[rend],0, renderer_size);
+				Output_Dsp::ConvertToFloat(buf + taken, samples, input_format, convert_buffer);
 			}
-			/*
-			 * treat each sample of the source as an array - one item for each channel.
-			 * treat each sample of the destination as a pointer and add the sample
-			 * index to it and copy the source to it.
-			 */
-			const short* src = (const short*)buf;
-			for ( unsigned int sample = 0 ; sample < (renderer_size/2) ; sample++ )
+			else
 			{
+				Output_Dsp::ConvertTo16(buf + taken, samples, input_format, (short*)convert_buffer, dither);
+			}
 
-				for ( unsigned char rend=0; rend < no_renderers ; rend++ )
-				{
-					*(short*)(((short*)buffers[rend]) + sample) = (src[rend]);
-				}
-				src += number_of_channels;
+			const unsigned int converted = frames * bytes_per_sample_channel;
+			const unsigned int written = WriteToRing((const char*)convert_buffer, converted);
+
+			stats.bytes_copied += converted;
+			taken += frames * input_frame_size;
+
+			// the ring is full, the rest is lost
+			if ( written < converted )
+			{
+				taken -= ((converted - written) / bytes_per_sample_channel) * input_frame_size;
+				break;
 			}
 		}
 
-		/* we write in a sepeate loop to ensure that they're close
-		 * together, if they're in the loop above the audio may drift */
-		for ( char rend=0; rend < no_renderers ; rend++ )
+		return taken;
+	}
+
+	/*
+		get expanded channels
+
+		how many channels (numchannels) becomes after mono or stereo
+		expansion
+	*/
+	int Output_Wumpus::GetExpandedChannels(const int numchannels)
+	{
+		if ( is_stereo_expanded && numchannels == 2 )
+		{
+			return numchannels + 2;
+		}
+		else if ( is_mono_expanded && numchannels == 1 )
 		{
-			renderers[rend]->Write(buffers[rend], renderer_size);
+			return numchannels + 3;
 		}
 
-		delete buf;
+		return numchannels;
 	}
 
 	/*
-		canwrite
-
-		this procedure is invoked by winamp when it determining
-		if more data can be written to the plugin
+		get output channels
+
+		how many channels the renderers are given for (numchannels),
+		after expansion or upmixing. if the device has no format for
+		that many the nearest layout that it does have is used, the
+		next one up so nothing is lost if there is one or the next
+		one down. split mode has a source for each speaker, so no
+		more than MAX_RENDERERS, anything wider is mixed down
 	*/
-	int Output_Wumpus::CanWrite()
+	int Output_Wumpus::GetOutputChannels(const int numchannels)
 	{
-		SYNC_START;
+		// stereo is upmixed to 5.1 if the device can play it
+		if ( upmix_enabled && numchannels == 2 &&
+			(split_out || Output_Renderer::IsFormatSupported(UPMIX_CHANNELS, SIXTEEN_BIT_PER_SAMPLE)) )
+		{
+			return UPMIX_CHANNELS;
+		}
 
-		int r = EMPTY_THE_BUFFER;
-		if(stream_open)
+		const int expanded = GetExpandedChannels(numchannels);
+
+		// split renderers are always mono
+		if ( split_out )
 		{
-			/*
-			 * find out if the first renderer can accept data,
-			 * all the renderers should have the same amount of data
-			 * free so we only need to ask one
-			 */
-			if ( no_renderers > 0 && renderers[0] )
+			return expanded > (int)MAX_RENDERERS ? (int)MAX_RENDERERS : expanded;
+		}
+
+		if ( Output_Renderer::IsFormatSupported(expanded, SIXTEEN_BIT_PER_SAMPLE) )
+		{
+			return expanded;
+		}
+
+		for ( int channels = expanded + 1 ; channels <= (int)BUS_MAX_CHANNELS ; channels++ )
+		{
+			if ( Output_Renderer::IsFormatSupported(channels, SIXTEEN_BIT_PER_SAMPLE) )
 			{
-				r = renderers[0]->CanWrite();
+				return channels;
 			}
+		}
 
-			/*
-			 * don't attach the temp_size as it may cause overflows
-			 * as we may tell winamp that we want more than we can handle
-			 */
-			if ( r >= temp_size)
+		for ( int channels = expanded - 1 ; channels > 1 ; channels-- )
+		{
+			if ( Output_Renderer::IsFormatSupported(channels, SIXTEEN_BIT_PER_SAMPLE) )
 			{
-				r -= temp_size;
+				return channels;
 			}
 		}
 
-		SYNC_END;
-		
-		return r;
+		return 2;
 	}
 
 	/*
-		isplaying
+		can play float
 
-		invoked by winamp to determine if there is still data in the buffers
-		return 0 if empty
-		return <0> if data present
+		true if open al can take float audio in the layout the
+		renderers will be given, every split renderer is mono
 	*/
-	int Output_Wumpus::IsPlaying()
+	bool Output_Wumpus::CanPlayFloat(const int numchannels)
 	{
-		SYNC_START;
-
-		if ( stream_open )
+		if ( Framework::getInstance()->ALFWIsFloat32Supported() != AL_TRUE )
 		{
-			this->CheckProcessedBuffers();
+			return false;
+		}
 
-			if(!pre_buffer)
-			{
-				this->CheckPlayState();
-			}
+		switch ( split_out ? 1 : numchannels )
+		{
+		case 1:
+		case 2:
+			return true;
+		case 4:
+			return alGetEnumValue("AL_FORMAT_QUAD32") != 0;
+		case 6:
+			return alGetEnumValue("AL_FORMAT_51CHN32") != 0;
+		case 7:
+			return alGetEnumValue("AL_FORMAT_61CHN32") != 0;
+		case 8:
+			return alGetEnumValue("AL_FORMAT_71CHN32") != 0;
 		}
 
-		int r = is_playing && stream_open ? IS_PLAYING : IS_NOT_PLAYING;
-		SYNC_END;
-		return r;
+		return false;
 	}
 
-	/*
-		pause
-
-		returns the previous pause state
-	*/
-	int Output_Wumpus::Pause(const int pause)
+	bool Output_Wumpus::CanSubmitBlock()
 	{
-		SYNC_START;
-		last_pause = pause;
-		
-		// clear the error state
-		alGetError();
+		if ( no_renderers == 0 )
+		{
+			return false;
+		}
 
-		// if this is un-paused during pre-buffering
-		// we may start to play data before it's ready
-		// and cause and under-run
-		
-		if ( !this->pre_buffer || last_pause )
+		for ( char rend=0; rend < no_renderers ; rend++ )
 		{
-			for ( char rend=0 ; rend < no_renderers ; rend++ )
+			if ( renderers[rend] == NULL ||
+				!renderers[rend]->HasFreeBuffer() )
 			{
-				if ( renderers[rend] )
-				{
-					renderers[rend]->Pause(pause);
-				}
+				return false;
 			}
 		}
 
-		SYNC_END;
-		return last_pause;
+		return true;
 	}
 
-	/*
-		setvolume
-
-		this procedure is invoked by winamp to set the volume
-	*/
-	void Output_Wumpus::SetVolume(const int new_volume)
+	void Output_Wumpus::WriteBlock(const char * buf, const int len)
 	{
-		/*
-			work out the % volume (as a float) and set it
-		*/
-		SYNC_START;
+		const char * outputs[MAX_RENDERERS];
+		int output_len[MAX_RENDERERS];
 
-		if(stream_open)
+		// all the scratch memory from the last block is free again
+		arena->Reset();
+
+		if ( !ProcessBlock(buf, len, outputs, output_len) )
 		{
-			// calculate the volume to use (0.0 to 1.0)
-			ALfloat new_int_volume = (ALfloat)new_volume / (ALfloat)VOLUME_DIVISOR;
-			this->SetVolumeInternal(new_int_volume);
+			return;
 		}
-		
-		SYNC_END;
-	}
 
-	/*
-		set volume (internal) - used to check the volume range
-		and store the volume for later use
-	*/
-	void Output_Wumpus::SetVolumeInternal(const ALfloat new_volume)
-	{
-		if(new_volume <= VOLUME_MAX && new_volume >= VOLUME_MIN)
+		// the written position counts the expanded stream
+		total_written += len * number_of_channels / original_number_of_channels;
+
+		/* we write in a sepeate loop to ensure that they're close
+		 * together, if they're in the loop above the audio may drift */
+		for ( char rend=0; rend < no_renderers ; rend++ )
 		{
-			volume = new_volume;
-			
-			for ( char rend=0 ; rend < no_renderers ; rend++ )
+			renderers[rend]->Write(outputs[rend], output_len[rend]);
+			stats.bytes_out += output_len[rend];
+		}
+
+		/*
+		 * prebuffering ends once enough audio is queued, a short
+		 * queue can fill up before then
+		 */
+		if(pre_buffer)
+		{
+			pre_buffer_frames += len / 
+				((bits_per_sample >> SHIFT_BITS_TO_BYTES) * original_number_of_channels);
+
+			if(pre_buffer_frames >= pre_buffer_target || !CanSubmitBlock())
 			{
-				if ( renderers[rend] )
-				{
-					renderers[rend]->SetVolumeInternal(volume);
-				}
+				pre_buffer = false;
 			}
-
-			ConfigFile::WriteInteger(CONF_VOLUME, (int)(volume * VOLUME_DIVISOR) );
 		}
-	}
-
-	/*
-		setpan
 
-		this procedure is invoked by winamp to set the pan
-	*/
-	void Output_Wumpus::SetPan(const int new_pan)
-	{
-		ALfloat f = ((ALfloat)new_pan)/255.0f; 
-		this->speaker_matrix.position.x = -f;
-		//alListener3f(AL_POSITION, -f ,0.0,0.0);
+		/* now that there is data in the buffers check the play
+		state. if nothing is playing then either a buffer under-run
+		has occured or this is the first time the file has been written.
+		it could also be a small file that the monitor thread might not see
+		*/
+		if(!pre_buffer)
+		{
+			this->CheckPlayState();
+		}
 	}
 
 	/*
-		flush
+		process block
 
-		this procedure is invoked by winamp to flush the buffers
-		and start playing from time (t)ms.
+		get a block from the ring in to the layout each renderer
+		wants, reading every input sample once. depending on the
+		plan the renderers are given the ring data itself or memory
+		from the arena. (outputs) and (output_len) have an entry for
+		each renderer.
 	*/
-	void Output_Wumpus::Flush(const int new_time_in_ms)
+	bool Output_Wumpus::ProcessBlock(
+		const char * buf,
+		const int len,
+		const char ** outputs,
+		int * output_len)
 	{
-		SYNC_START;
+		const unsigned int sample_size = bits_per_sample >> SHIFT_BITS_TO_BYTES;
+		const unsigned int frames = len / (sample_size * original_number_of_channels);
 
-		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		switch ( plan )
 		{
-			if ( renderers[rend] )
+		case BLOCK_EXPAND:
 			{
-				renderers[rend]->Flush();
-			}
-		}
+				const int expanded_len = 
+					len * number_of_channels / original_number_of_channels;
 
-#ifdef _DEBUGGING
-		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
-		sprintf_s(
-			dbg,
-			DEBUG_BUFFER_SIZE,
-			"Jump to %d, max length is %d\n", new_time_in_ms, Winamp::GetTrackLength());
-		log_debug_msg(dbg, __FILE__, __LINE__);
-#endif
+				char * expanded = arena->Allocate(expanded_len);
+				if ( expanded == NULL )
+				{
+					return false;
+				}
 
-		bool closing = false;
+				if ( original_number_of_channels == 1 )
+				{
+					Output_Dsp::ExpandMonoToQuad(buf, frames, sample_size, expanded);
+				}
+				else
+				{
+					Output_Dsp::ExpandStereoToQuad(buf, frames, sample_size, expanded);
+				}
+
+				stats.bytes_copied += expanded_len;
+
+				outputs[0] = expanded;
+				output_len[0] = expanded_len;
+			}
+			break;
+
+		case BLOCK_SPLIT:
+		case BLOCK_EXPAND_STEREO_SPLIT:
+			{
+				// only the channels that are really in the stream are
+				// deinterleaved, an expanded rear pair shares the front
+				char * buffers[MAX_RENDERERS];
+				const int renderer_len = frames * sample_size;
+
+				if ( original_number_of_channels > MAX_RENDERERS )
+				{
+					return false;
+				}
+
+				for ( unsigned int channel = 0 ; channel < original_number_of_channels ; channel++ )
+				{
+					buffers[channel] = arena->Allocate(renderer_len);
+					if ( buffers[channel] == NULL )
+					{
+						return false;
+					}
+				}
+
+				Output_Dsp::Deinterleave(
+					buf,
+					frames,
+					original_number_of_channels,
+					sample_size,
+					buffers);
+
+				stats.bytes_copied += len;
+
+				for ( char rend=0; rend < no_renderers ; rend++ )
+				{
+					outputs[rend] = buffers[rend % original_number_of_channels];
+					output_len[rend] = renderer_len;
+				}
+			}
+			break;
+
+		case BLOCK_BUS:
+			{
+				// one buffer for each split renderer, or one interleaved
+				char * buffers[MAX_RENDERERS];
+				const int renderer_len = split_out ? 
+					frames * sample_size : 
+					frames * sample_size * number_of_channels;
+
+				if ( no_renderers > MAX_RENDERERS || (split_out && number_of_channels > MAX_RENDERERS) )
+				{
+					return false;
+				}
+
+				for ( char rend=0; rend < no_renderers ; rend++ )
+				{
+					buffers[rend] = arena->Allocate(renderer_len);
+					if ( buffers[rend] == NULL )
+					{
+						return false;
+					}
+
+					outputs[rend] = buffers[rend];
+					output_len[rend] = renderer_len;
+				}
+
+				bus.Process(buf, frames, buffers, split_out);
+
+				stats.bytes_copied += renderer_len * no_renderers;
+			}
+			break;
+
+		case BLOCK_EXPAND_MONO_SPLIT:
+			// every speaker gets exactly what's in the ring
+			for ( char rend=0; rend < no_renderers ; rend++ )
+			{
+				outputs[rend] = buf;
+				output_len[rend] = len;
+			}
+			break;
+
+		default:
+			outputs[0] = buf;
+			output_len[0] = len;
+			break;
+		}
+
+		return true;
+	}
+
+	/*
+		canwrite
+
+		this procedure is invoked by winamp when it determining
+		if more data can be written to the plugin
+	*/
+	int Output_Wumpus::CanWrite()
+	{
+		int r = EMPTY_THE_BUFFER;
+
+		if ( threaded )
+		{
+			/*
+			 * the same lock as Write, it keeps Open and Close from
+			 * changing the ring and the format under us
+			 */
+			EnterCriticalSection(&ring_critical_section);
+
+			stats.lock_calls++;
+
+			if ( stream_open )
+			{
+				r = GetWriteSpace(published_space);
+			}
+
+			LeaveCriticalSection(&ring_critical_section);
+		}
+		else
+		{
+			SYNC_START;
+
+			stats.lock_calls++;
+
+			Output_Stats::BeginAudioPath();
+
+			if ( stream_open )
+			{
+				// winamp keeps asking while it waits, even when paused
+				AdvanceRamp();
+
+				r = GetWriteSpace(GetRendererSpace());
+			}
+
+			Output_Stats::EndAudioPath();
+
+			SYNC_END;
+		}
+		
+		return r;
+	}
+
+	/*
+		get write space
+
+		how many of winamp's bytes can be written, given (space)
+		bytes of the ring's data the renderers could take. only call
+		this holding the lock, or the ring lock in threaded mode
+	*/
+	int Output_Wumpus::GetWriteSpace(const int space)
+	{
+		int r = space;
+
+		/*
+		 * take off what's already waiting in the ring, other than
+		 * the end being held back for a fade, and never offer more
+		 * than the ring can hold
+		 */
+		const int ring_held = (int)GetHeldBytes();
+		int ring_used = (int)ring->GetUsed() - ring_held;
+		if ( ring_used < 0 )
+		{
+			ring_used = 0;
+		}
+		const int ring_free = (int)ring->GetFree();
+
+		// the queue can be smaller than winamp's writes
+		if ( r < (int)write_space )
+		{
+			r = (int)write_space;
+		}
+
+		r = (r > ring_used) ? (r - ring_used) : 0;
+		if ( r > ring_free )
+		{
+			r = ring_free;
+		}
+
+		stats.can_write_calls++;
+
+		if ( write_batching )
+		{
+			r = GetBatchSpace(r);
+		}
+
+		// the ring holds converted audio, winamp's frames are a different size
+		if ( converting && bytes_per_sample_channel > 0 )
+		{
+			r = (int)((r / bytes_per_sample_channel) * 
+				(input_bits_per_sample >> SHIFT_BITS_TO_BYTES) * original_number_of_channels);
+		}
+
+		return r;
+	}
+
+	/*
+		get batch space
+
+		hysteresis on the space offered to winamp. once there isn't
+		room for another of its writes nothing is offered until enough
+		of the queue is free to take a big batch, so winamp wakes up
+		and writes less often
+	*/
+	int Output_Wumpus::GetBatchSpace(const int space)
+	{
+		/*
+		 * the watermark is a share of the queue in winamp's bytes,
+		 * but never more than the ring could ever offer
+		 */
+		int watermark = (int)(
+			(Output_Clock::MsToFrames(GetQueueMaximum(), sample_rate) * 
+			bytes_per_sample_channel * WRITE_BATCH_PERCENT) / 100);
+
+		const int ring_limit = (int)(ring->GetCapacity() / 2);
+		if ( watermark > ring_limit )
+		{
+			watermark = ring_limit;
+		}
+
+		/*
+		 * winamp stops writing once there isn't room for one of its
+		 * packets, so the batch closes when there's less than its
+		 * biggest write left rather than when it's completely full
+		 */
+		const unsigned int input_frame_size =
+			(input_bits_per_sample >> SHIFT_BITS_TO_BYTES) * original_number_of_channels;
+		int low_watermark = (int)((stats.largest_write / input_frame_size) * bytes_per_sample_channel);
+
+		if ( low_watermark < (int)bytes_per_sample_channel )
+		{
+			low_watermark = (int)bytes_per_sample_channel;
+		}
+		else if ( low_watermark > watermark )
+		{
+			low_watermark = watermark;
+		}
+
+		if ( space < low_watermark )
+		{
+			batch_open = false;
+		}
+		else if ( !batch_open && (space >= watermark || pre_buffer) )
+		{
+			// while prebuffering there's no point holding anything back
+			batch_open = true;
+		}
+
+		if ( !batch_open )
+		{
+			stats.can_write_held++;
+			return 0;
+		}
+
+		return space;
+	}
+
+	/*
+		get renderer space
+
+		how many bytes of the ring's data the renderers could take,
+		only call this holding the lock
+	*/
+	int Output_Wumpus::GetRendererSpace()
+	{
+		int r = EMPTY_THE_BUFFER;
+
+		/*
+		 * find out if the first renderer can accept data,
+		 * all the renderers should have the same amount of data
+		 * free so we only need to ask one
+		 */
+		if ( no_renderers > 0 && renderers[0] )
+		{
+			r = renderers[0]->CanWrite();
+		}
+
+		/*
+		 * the renderers count bytes after expansion and splitting,
+		 * turn that back in to bytes of the ring's data
+		 */
+		return (int)(((__int64)r * original_number_of_channels) / 
+			(split_out ? 1 : number_of_channels));
+	}
+
+	/*
+		isplaying
+
+		invoked by winamp to determine if there is still data in the buffers
+		return 0 if empty
+		return <0> if data present
+	*/
+	int Output_Wumpus::IsPlaying()
+	{
+		if ( threaded )
+		{
+			/*
+			 * winamp has run out of data, let the worker send
+			 * whatever is left in the ring
+			 */
+			if ( stream_open )
+			{
+				InterlockedExchange(&draining, TRUE);
+				SetEvent(worker_event);
+			}
+
+			return published_playing && stream_open ? IS_PLAYING : IS_NOT_PLAYING;
+		}
+
+		SYNC_START;
+
+		Output_Stats::BeginAudioPath();
+
+		if ( stream_open )
+		{
+			InterlockedExchange(&draining, TRUE);
+
+			this->CheckProcessedBuffers();
+
+			/*
+			 * winamp asks this when it's run out of data, so send
+			 * whatever is left in the ring
+			 */
+			SubmitBlocks(true);
+
+			// there's no more coming so there's nothing to wait for
+			pre_buffer = false;
+
+			this->CheckPlayState();
+		}
+
+		int r = is_playing && stream_open && !IsHandingOver() ? IS_PLAYING : IS_NOT_PLAYING;
+
+		Output_Stats::EndAudioPath();
+
+		SYNC_END;
+		return r;
+	}
+
+	/*
+		play sources
+
+		start a group of sources, fading them in if they were faded
+		out when they were paused or flushed
+	*/
+	void Output_Wumpus::PlaySources(const ALuint * sources, const int count)
+	{
+		const bool ramping = ramp_in && count > 0;
+
+		if ( ramping )
+		{
+			SetSourceGains(0.0f);
+		}
+
+		ControlSources(SOURCES_PLAY, sources, count);
+
+		if ( ramping )
+		{
+			ramp_in = false;
+			StartRamp(0.0f, volume, false);
+		}
+	}
+
+	/*
+		set source gains
+
+		set the gain of every source in the same mixer update
+	*/
+	void Output_Wumpus::SetSourceGains(const ALfloat gain)
+	{
+		source_gain = gain;
+
+		if ( deferred_updates )
+		{
+			alDeferUpdatesSOFT();
+		}
+
+		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		{
+			if ( renderers[rend] )
+			{
+				renderers[rend]->SetGain(gain);
+			}
+		}
+
+		if ( deferred_updates )
+		{
+			alProcessUpdatesSOFT();
+		}
+	}
+
+	/*
+		start ramp
+
+		start moving the gain of the sources from (from) to (to)
+		over DECLICK_RAMP_MS, (pause) pauses them at the end. it
+		never waits, AdvanceRamp takes it the rest of the way
+	*/
+	void Output_Wumpus::StartRamp(const ALfloat from, const ALfloat to, const bool pause)
+	{
+		ramp_start = Output_Stats::GetSeconds();
+		ramp_from = from;
+		ramp_to = to;
+		ramp_pause = pause;
+
+		SetSourceGains(from);
+	}
+
+	/*
+		advance ramp
+
+		set the gain to where the ramp should be by now. open al
+		smooths each change over a mixer update so however far
+		apart the steps come there's no click. nothing that's
+		queued is touched so it adds no latency
+	*/
+	void Output_Wumpus::AdvanceRamp()
+	{
+		if ( ramp_start <= 0.0 )
+		{
+			return;
+		}
+
+		const double length = (double)DECLICK_RAMP_MS / (double)ONE_SECOND_IN_MS;
+		const double elapsed = Output_Stats::GetSeconds() - ramp_start;
+
+		if ( elapsed < length )
+		{
+			SetSourceGains(ramp_from + (ramp_to - ramp_from) * (ALfloat)(elapsed / length));
+			return;
+		}
+
+		SetSourceGains(ramp_to);
+		ramp_start = 0.0;
+
+		if ( ramp_pause )
+		{
+			ALuint sources[MAX_RENDERERS];
+			ControlSources(SOURCES_PAUSE, sources, GetSources(sources));
+			ramp_pause = false;
+		}
+	}
+
+	/*
+		is audible
+
+		true if the sources are playing and can be heard, only
+		then is there anything to ramp
+	*/
+	bool Output_Wumpus::IsAudible()
+	{
+		return stream_open && is_playing && !last_pause && !ramp_in;
+	}
+
+	/*
+		pause
+
+		returns the previous pause state
+	*/
+	int Output_Wumpus::Pause(const int pause)
+	{
+		SYNC_START;
+
+		const bool audible = IsAudible();
+
+		last_pause = pause;
+		
+		// clear the error state
+		alGetError();
+
+		// if this is un-paused during pre-buffering
+		// we may start to play data before it's ready
+		// and cause and under-run
+		
+		if ( !this->pre_buffer || last_pause )
+		{
+			for ( char rend=0 ; rend < no_renderers ; rend++ )
+			{
+				if ( renderers[rend] )
+				{
+					renderers[rend]->Pause(pause);
+				}
+			}
+
+			ALuint sources[MAX_RENDERERS];
+			const int source_count = GetSources(sources);
+
+			if ( pause )
+			{
+				// fade out before pausing, and back in again after
+				if ( audible )
+				{
+					StartRamp(source_gain, 0.0f, true);
+				}
+				else
+				{
+					ramp_start = 0.0;
+					ControlSources(SOURCES_PAUSE, sources, source_count);
+				}
+				ramp_in = true;
+			}
+			else if ( ramp_start > 0.0 && ramp_pause )
+			{
+				// still fading out, they never stopped so just turn back
+				ramp_in = false;
+				StartRamp(source_gain, volume, false);
+			}
+			else
+			{
+				PlaySources(sources, source_count);
+			}
+		}
+
+		// stop the position moving on while we're paused
+		UpdatePosition();
+
+		SYNC_END;
+		return last_pause;
+	}
+
+	/*
+		setvolume
+
+		this procedure is invoked by winamp to set the volume
+	*/
+	void Output_Wumpus::SetVolume(const int new_volume)
+	{
+		/*
+			work out the % volume (as a float) and set it
+		*/
+		SYNC_START;
+
+		if(stream_open)
+		{
+			// calculate the volume to use (0.0 to 1.0)
+			ALfloat new_int_volume = (ALfloat)new_volume / (ALfloat)VOLUME_DIVISOR;
+
+			const bool audible = IsAudible();
+
+			/*
+			 * the sources only move to the new volume through a
+			 * ramp, a fade out for a pause carries on to nothing
+			 */
+			if ( StoreVolume(new_int_volume) )
+			{
+				if ( audible )
+				{
+					StartRamp(source_gain, volume, false);
+				}
+				else if ( ramp_start > 0.0 )
+				{
+					if ( !ramp_pause )
+					{
+						ramp_to = volume;
+					}
+				}
+				else
+				{
+					// nothing can be heard so there's nothing to click
+					SetSourceGains(volume);
+				}
+			}
+		}
+		
+		SYNC_END;
+	}
+
+	/*
+		store volume
+
+		check the volume range, then store it and save it to the
+		config without touching the sources. false if it's out of
+		range
+	*/
+	bool Output_Wumpus::StoreVolume(const ALfloat new_volume)
+	{
+		if(new_volume <= VOLUME_MAX && new_volume >= VOLUME_MIN)
+		{
+			volume = new_volume;
+
+			ConfigFile::WriteInteger(CONF_VOLUME, (int)(volume * VOLUME_DIVISOR) );
+			return true;
+		}
+
+		return false;
+	}
+
+	/*
+		set volume (internal) - used to check the volume range
+		and store the volume for later use, the sources are set to
+		it straight away
+	*/
+	void Output_Wumpus::SetVolumeInternal(const ALfloat new_volume)
+	{
+		if( StoreVolume(new_volume) )
+		{
+			source_gain = new_volume;
+			
+			for ( char rend=0 ; rend < no_renderers ; rend++ )
+			{
+				if ( renderers[rend] )
+				{
+					renderers[rend]->SetVolumeInternal(volume);
+				}
+			}
+		}
+	}
+
+	/*
+		setpan
+
+		this procedure is invoked by winamp to set the pan
+	*/
+	void Output_Wumpus::SetPan(const int new_pan)
+	{
+		ALfloat f = ((ALfloat)new_pan)/255.0f; 
+		this->speaker_matrix.position.x = -f;
+		//alListener3f(AL_POSITION, -f ,0.0,0.0);
+	}
+
+	/*
+		flush
+
+		this procedure is invoked by winamp to flush the buffers
+		and start playing from time (t)ms.
+	*/
+	void Output_Wumpus::Flush(const int new_time_in_ms)
+	{
+		SYNC_START;
+
+		/*
+		 * what's queued is thrown away so there's nothing to fade
+		 * out without holding up the seek, the new position is
+		 * faded in instead
+		 */
+		ramp_start = 0.0;
+
+		// make sure we've stopped playing
+		ALuint sources[MAX_RENDERERS];
+		const int source_count = GetSources(sources);
+
+		ControlSources(SOURCES_STOP, sources, source_count);
+
+#ifdef _DEBUGGING
+		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+		sprintf_s(
+			dbg,
+			DEBUG_BUFFER_SIZE,
+			"Jump to %d, max length is %d\n", new_time_in_ms, Winamp::GetTrackLength());
+		log_debug_msg(dbg, __FILE__, __LINE__);
+#endif
+
+		bool closing = false;
 
 		/*
 		 * this checks that we can only flush (skip) when the steam is open
@@ -1315,34 +2952,105 @@ namespace WinampOpenALOut {
 		 */
 		if ( stream_open )//&& (new_time_in_ms < (Winamp::GetTrackLength()-conf_buffer_length)) )
 		{
-			// calculate the number of bytes that will have been
-			// this will relocate to the current device at a set time
-			this->Relocate(Framework::getInstance()->GetCurrentDevice(), new_time_in_ms, split_out);
+			start_requested = Output_Stats::GetSeconds();
+
+			// empty everything and carry on from the new time
+			this->Restart(new_time_in_ms);
 
 			CheckPlayState();
 
 			if ( last_pause )
 			{
-				for ( char rend=0 ; rend < no_renderers ; rend++ )
-				{
-					if ( renderers[rend] )
-					{
-						renderers[rend]->Pause(last_pause);
-					}
-				}
+				for ( char rend=0 ; rend < no_renderers ; rend++ )
+				{
+					if ( renderers[rend] )
+					{
+						renderers[rend]->Pause(last_pause);
+					}
+				}
+
+				ControlSources(
+					SOURCES_PAUSE,
+					sources,
+					GetSources(sources));
+			}
+
+		}else{
+			this->Close();
+			closing = true;
+		}
+
+#ifdef _DEBUGGING
+		if ( !closing )
+		{
+			sprintf_s(
+				dbg,
+				DEBUG_BUFFER_SIZE,
+				"Flush took {%.3f} ms",
+				(Output_Stats::GetSeconds() - start_requested) * ONE_SECOND_IN_MS);
+			log_debug_msg(dbg, __FILE__, __LINE__);
+		}
+#endif
+
+		SYNC_END;
+
+		if ( closing )
+		{
+			Winamp::Next();
+		}
+	}
+
+	/*
+		restart
+
+		throw away everything that's queued and carry on from
+		(new_time_in_ms). the sources have to be stopped already,
+		every open al object and the effects stay as they are so
+		the next audio only has to get through the fast start
+	*/
+	void Output_Wumpus::Restart(const int new_time_in_ms)
+	{
+		for ( char rend=0 ; rend < no_renderers ; rend++ )
+		{
+			if ( renderers[rend] )
+			{
+				renderers[rend]->Reset();
 			}
-
-		}else{
-			this->Close();
-			closing = true;
 		}
 
-		SYNC_END;
+		EnterCriticalSection(&ring_critical_section);
+		ring->Reset();
+		fade_remaining = 0;
+		partial_bytes = 0;
+		LeaveCriticalSection(&ring_critical_section);
 
-		if ( closing )
+		arena->Reset();
+
+		// nothing from before the seek is left in the upmixer
+		upmix.Reset();
+		if ( upmix.IsOpen() )
 		{
-			Winamp::Next();
+			upmix.GetSilence(&upmix_tail);
 		}
+
+		is_playing = false;
+		InterlockedExchange(&draining, FALSE);
+
+		// only wait for enough to get going again
+		pre_buffer = true;
+		pre_buffer_frames = 0;
+		pre_buffer_target = Output_Clock::MsToFrames(fast_start_ms, sample_rate);
+		restarted = true;
+
+		// the new position fades in when it starts
+		ramp_in = true;
+
+		drift.Start(sample_rate);
+
+		// move the clock and the written and played counts
+		this->SetBufferTime(new_time_in_ms);
+
+		PublishState();
 	}
 
 	int Output_Wumpus::SetBufferTime(const int new_ms)
@@ -1352,11 +3060,12 @@ namespace WinampOpenALOut {
 		int calcTime;
 
 		SYNC_START;
+
+		const unsigned __int64 frames = Output_Clock::MsToFrames(new_ms, sample_rate);
 		
-		calcTime = 
-			((((sample_rate / ONE_SECOND_IN_MS) *
-			(bits_per_sample >> SHIFT_BITS_TO_BYTES)) *
-			number_of_channels) * new_ms);
+		calcTime = (int)(frames *
+			(bits_per_sample >> SHIFT_BITS_TO_BYTES) *
+			number_of_channels);
 
 #ifdef _DEBUGGING
 		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
@@ -1372,23 +3081,24 @@ namespace WinampOpenALOut {
 		log_debug_msg(dbg, __FILE__, __LINE__);
 #endif
 
-		const unsigned __int64 new_time = calcTime / no_renderers;
-
 		for ( char rend = 0 ; rend < no_renderers ; rend++ )
 		{
 			if ( renderers[rend] )
 			{
-				renderers[rend]->SetPlayedTime(new_time);
+				renderers[rend]->SetPlayedFrames(frames);
 			}
 		}
 
+		clock.Start(sample_rate, new_ms);
+
+		// the renderers count from this track again
+		track_start_frames = 0;
+
 		// reset played pointers
 		total_written = calcTime;
 		total_played = calcTime;
-		last_output_time = new_ms;
-		last_written_time = new_ms;
-		current_output_time = new_ms;
-		current_written_time = new_ms;
+
+		UpdatePosition();
 
 		SYNC_END;
 
@@ -1402,95 +3112,424 @@ namespace WinampOpenALOut {
 	*/
 	int Output_Wumpus::GetWrittenTime()
 	{	
-		if(stream_open)
+		RefreshPosition();
+		return position.GetWrittenTime();
+	}
+
+	/*
+		getOutputTime
+
+		returns the time in ms of current position
+	*/
+	int Output_Wumpus::GetOutputTime()
+	{
+		RefreshPosition();
+		return position.GetOutputTime();
+	}
+
+	void Output_Wumpus::SetPositionExtrapolated(const bool enabled)
+	{
+		position.SetExtrapolated(enabled);
+		ConfigFile::WriteBoolean(CONF_EXTRAPOLATE, enabled);
+	}
+
+	void Output_Wumpus::SetMonoExpanded(const bool expanded)
+	{
+		is_mono_expanded = expanded;
+		ConfigFile::WriteBoolean(CONF_MONO_EXPAND,is_mono_expanded);
+	}
+
+	void Output_Wumpus::SetStereoExpanded(const bool expanded)
+	{ 
+		is_stereo_expanded = expanded;
+		ConfigFile::WriteBoolean(CONF_STEREO_EXPAND,is_stereo_expanded);
+	}
+
+	void Output_Wumpus::SetSplit ( const bool split )
+	{
+		ConfigFile::WriteBoolean(CONF_SPLIT,split);
+		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(),split);
+	}
+
+	void Output_Wumpus::SetThreaded( const bool enabled )
+	{
+		ConfigFile::WriteBoolean(CONF_THREADED, enabled);
+
+		if ( enabled )
 		{
-			current_written_time = total_written;
-			current_written_time = get_current_written_time(current_written_time, sample_rate) / bytes_per_sample_channel;
+			StartWorker();
+			threaded = true;
+		}
+		else
+		{
+			threaded = false;
+			StopWorker();
+		}
+	}
 
-			/*
-			 * we need to return the correct information. if we've expanded the data
-			 * we need to only return half those values
-			 */
-			if ( is_stereo_expanded && original_number_of_channels == 2)
-			{
-				current_written_time /= 2;
-			}
+	void Output_Wumpus::SetAutoTuned( const bool enabled )
+	{
+		SYNC_START;
 
-			if ( is_mono_expanded && original_number_of_channels == 1)
-			{
-				current_written_time /= 4;
-			}
+		auto_tune = enabled;
+		ConfigFile::WriteBoolean(CONF_AUTO_TUNE, enabled);
 
-		}else{
-			current_written_time = ZERO_TIME;
+		// the renderers have to be remade with the right number of buffers
+		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(), split_out);
+
+		SYNC_END;
+	}
+
+	/*
+		set chunk length
+
+		turn low latency mode on with each open al buffer holding
+		(ms) of audio, or off with 0
+	*/
+	void Output_Wumpus::SetChunkLength( const unsigned int ms )
+	{
+		SYNC_START;
+
+		if ( ms < LOW_LATENCY_CHUNK_MIN || ms > LOW_LATENCY_CHUNK_MAX )
+		{
+			chunk_ms = 0;
 		}
-		
-		// make sure we only use the first 32bits of the 64bit value
-		last_written_time = (int)(current_written_time & THIRTY_TWO_BIT_BIT_MASK);
-		return last_written_time;
+		else
+		{
+			chunk_ms = ms;
+		}
+		ConfigFile::WriteInteger(CONF_LOW_LATENCY, chunk_ms);
+
+		// the renderers have to be remade with the new buffer size
+		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(), split_out);
+
+		SYNC_END;
 	}
 
 	/*
-		getOutputTime
+		get queue maximum
 
-		returns the time in ms of current position
+		the most audio, in ms, that the renderers are made to hold
 	*/
-	int Output_Wumpus::GetOutputTime()
+	unsigned int Output_Wumpus::GetQueueMaximum()
 	{
-		if(stream_open)
+		if ( auto_tune )
 		{
-			__int64 new_total_played = 0;
-			for( char rend=0; rend < no_renderers ; rend++ )
-			{
-				if ( renderers[rend] )
-				{
-					new_total_played += renderers[rend]->GetPlayedTime();
-				}
-			}
+			return tuner.GetMaximum();
+		}
+		else if ( chunk_ms > 0 )
+		{
+			return chunk_ms * chunk_count;
+		}
+
+		return conf_buffer_length;
+	}
+
+	static DWORD WINAPI WorkerThread(LPVOID output)
+	{
+		((Output_Wumpus*)output)->RunWorker();
+		return 0;
+	}
+
+	/*
+		start worker
+
+		create the thread that does the open al work in threaded mode
+	*/
+	void Output_Wumpus::StartWorker()
+	{
+		if ( worker_thread != NULL )
+		{
+			return;
+		}
+
+		worker_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		InterlockedExchange(&worker_running, TRUE);
+
+		DWORD id = 0;
+		worker_thread = CreateThread(
+			NULL,
+			0,
+			(LPTHREAD_START_ROUTINE)&WorkerThread,
+			this,
+			0,
+			&id);
+
+		if ( worker_thread == NULL )
+		{
+			MessageBoxA(NULL, "Could not start the output thread", "Error", MB_OK);
+			CloseHandle(worker_event);
+			worker_event = NULL;
+			return;
+		}
+
+		SetThreadPriority(worker_thread, THREAD_PRIORITY_HIGHEST);
+	}
+
+	/*
+		stop worker
+
+		never call this holding the lock, the worker needs it to
+		finish what it's doing
+	*/
+	void Output_Wumpus::StopWorker()
+	{
+		if ( worker_thread == NULL )
+		{
+			return;
+		}
+
+		InterlockedExchange(&worker_running, FALSE);
+		SetEvent(worker_event);
+		WaitForSingleObject(worker_thread, INFINITE);
+
+		CloseHandle(worker_thread);
+		CloseHandle(worker_event);
+		worker_thread = NULL;
+		worker_event = NULL;
+	}
 
-			total_played = new_total_played;
+	/*
+		run worker
 
-			// this works it out how many bytes it is
-			current_output_time = total_played;
-			// this converts bytes to ms and does 32bit part
-			current_output_time =
-				get_current_output_time(current_output_time, sample_rate)
-				/ bytes_per_sample_channel;
+		wakes up when Write has given us data (or every
+		WORKER_WAIT_MS) to recycle buffers, give whole blocks to the
+		renderers and keep them playing
+	*/
+	void Output_Wumpus::RunWorker()
+	{
+		Output_Stats::SetAudioWorker(GetCurrentThreadId());
 
-			if ( is_stereo_expanded && original_number_of_channels == 2)
+		while ( worker_running )
+		{
+			// short buffers and gain ramps need looking at more often
+			DWORD wait_ms = (chunk_ms > 0 && chunk_ms < WORKER_WAIT_MS) ? chunk_ms : WORKER_WAIT_MS;
+			if ( ramp_start > 0.0 )
 			{
-				current_output_time /= 2;
+				wait_ms = DECLICK_STEP_MS;
 			}
 
-			if ( is_mono_expanded && original_number_of_channels == 1)
+			WaitForSingleObject(worker_event, wait_ms);
+
+			SYNC_START;
+
+			if ( stream_open )
 			{
-				current_output_time /= 4;
+				AdvanceRamp();
+
+				this->CheckProcessedBuffers();
+
+				SubmitBlocks(draining != FALSE);
+
+				if ( draining )
+				{
+					pre_buffer = false;
+				}
+
+				if ( !pre_buffer )
+				{
+					this->CheckPlayState();
+				}
 			}
 
-		}else{
-			current_output_time = ZERO_TIME;
+			PublishState();
+
+			SYNC_END;
 		}
 
-		last_output_time = (int)(current_output_time & THIRTY_TWO_BIT_BIT_MASK);
-		return last_output_time;
+		Output_Stats::SetAudioWorker(0);
 	}
 
-	void Output_Wumpus::SetMonoExpanded(const bool expanded)
+	/*
+		set stream open
+
+		threaded Write only takes the ring lock, so (stream_open) is
+		changed holding it as well. everything Open sets up before
+		the stream is opened is seen by Write once it's open
+	*/
+	void Output_Wumpus::SetStreamOpen(const bool open)
 	{
-		is_mono_expanded = expanded;
-		ConfigFile::WriteBoolean(CONF_MONO_EXPAND,is_mono_expanded);
+		EnterCriticalSection(&ring_critical_section);
+		stream_open = open;
+		LeaveCriticalSection(&ring_critical_section);
 	}
 
-	void Output_Wumpus::SetStereoExpanded(const bool expanded)
-	{ 
-		is_stereo_expanded = expanded;
-		ConfigFile::WriteBoolean(CONF_STEREO_EXPAND,is_stereo_expanded);
+	/*
+		publish state
+
+		work out the answers to CanWrite and IsPlaying for winamp's
+		thread, only call this holding the lock
+	*/
+	void Output_Wumpus::PublishState()
+	{
+		LONG space = EMPTY_THE_BUFFER;
+		LONG playing = FALSE;
+
+		if ( stream_open )
+		{
+			space = GetRendererSpace();
+			playing = ((is_playing || ring->GetUsed() > GetHeldBytes()) && !IsHandingOver()) ? TRUE : FALSE;
+		}
+
+		InterlockedExchange(&published_space, space);
+		InterlockedExchange(&published_playing, playing);
 	}
 
-	void Output_Wumpus::SetSplit ( const bool split )
+	/*
+		is handing over
+
+		in gapless or crossfade mode, true once winamp has given us
+		the whole track and there's little enough left to play that
+		the next one should be opened
+	*/
+	bool Output_Wumpus::IsHandingOver()
 	{
-		ConfigFile::WriteBoolean(CONF_SPLIT,split);
-		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(),split);
+		if ( (!gapless && fade_bytes == 0) || !draining || ring->GetUsed() > GetHeldBytes() )
+		{
+			return false;
+		}
+
+		position_snapshot snapshot;
+		position.Read(&snapshot);
+
+		return (snapshot.written_ms - snapshot.output_ms) <= (int)GAPLESS_HANDOVER_MS;
+	}
+
+	/*
+		can continue
+
+		the lingering renderers can take the new track if it's in
+		the same format, after expansion, as the last one
+	*/
+	bool Output_Wumpus::CanContinue(
+		const int samplerate,
+		const int numchannels,
+		const int bitspersamp)
+	{
+		return no_renderers > 0 &&
+			samplerate == (int)sample_rate &&
+			numchannels == (int)original_number_of_channels &&
+			GetOutputChannels(numchannels) == (int)number_of_channels &&
+			bitspersamp == (int)input_bits_per_sample;
+	}
+
+	/*
+		continue
+
+		start the next track behind the end of the last one. the
+		new track starts where the last one was written up to, the
+		renderers keep counting so the boundary is exact
+	*/
+	void Output_Wumpus::Continue()
+	{
+		const unsigned int frame_size =
+			(bits_per_sample >> SHIFT_BITS_TO_BYTES) * number_of_channels;
+
+		track_start_frames += total_written / frame_size;
+
+		total_written = ZERO_TIME;
+		total_played = ZERO_TIME;
+		partial_bytes = 0;
+
+		/*
+		 * whatever the last track left in the ring is faded out
+		 * under the start of this one
+		 */
+		fade_bytes = fade_capacity;
+		fade_position = 0;
+		fade_length = bytes_per_sample_channel > 0 ? 
+			ring->GetUsed() / bytes_per_sample_channel : 0;
+		InterlockedExchange(&fade_remaining, (LONG)(fade_length * bytes_per_sample_channel));
+
+		// see if the end of the last track is still going
+		this->CheckPlayState();
+
+		InterlockedExchange(&draining, FALSE);
+
+		/*
+		 * if it ran out before we were opened this is a restart,
+		 * otherwise there's nothing to wait for
+		 */
+		pre_buffer = !is_playing;
+		pre_buffer_frames = 0;
+		pre_buffer_target = Output_Clock::MsToFrames(fast_start_ms, sample_rate);
+		start_requested = is_playing ? 0.0 : Output_Stats::GetSeconds();
+		restarted = false;
+
+		stats.Start();
+		clock.Start(sample_rate, ZERO_TIME);
+
+		SetStreamOpen(true);
+
+		UpdatePosition();
+		PublishState();
+
+#ifdef _DEBUGGING
+		char dbg[DEBUG_BUFFER_SIZE] = {'\0'};
+		sprintf_s(
+			dbg,
+			DEBUG_BUFFER_SIZE,
+			"-> Gapless, track starts at frame {%I64u}, still playing {%d}",
+			track_start_frames,
+			is_playing);
+		log_debug_msg(dbg, __FILE__, __LINE__);
+#endif
+	}
+
+	void Output_Wumpus::SetGapless(const bool enabled)
+	{
+		SYNC_START;
+
+		gapless = enabled;
+		ConfigFile::WriteBoolean(CONF_GAPLESS, enabled);
+
+		SYNC_END;
+	}
+
+	void Output_Wumpus::SetCrossfadeLength(const unsigned int ms)
+	{
+		crossfade_ms = ms > CROSSFADE_MAX_MS ? CROSSFADE_MAX_MS : ms;
+		ConfigFile::WriteInteger(CONF_CROSSFADE, crossfade_ms);
+
+		// the ring has to be sized for the new length
+		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(),split_out);
+	}
+
+	void Output_Wumpus::SetFloatBus(const bool enabled)
+	{
+		float_bus = enabled;
+		ConfigFile::WriteBoolean(CONF_FLOAT_BUS, enabled);
+		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(),split_out);
+	}
+
+	void Output_Wumpus::SetBusBlockFrames(const unsigned int frames)
+	{
+		if ( frames >= BUS_BLOCK_FRAMES_MIN && frames <= BUS_BLOCK_FRAMES_MAX )
+		{
+			bus_block_frames = frames & ~(BUS_BLOCK_FRAMES_MIN - 1);
+			ConfigFile::WriteInteger(CONF_BUS_BLOCK_FRAMES, bus_block_frames);
+			SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(),split_out);
+		}
+	}
+
+	void Output_Wumpus::SetUpmix(const bool enabled)
+	{
+		upmix_enabled = enabled;
+		ConfigFile::WriteBoolean(CONF_UPMIX, enabled);
+		SwitchOutputDevice(Framework::getInstance()->GetCurrentDevice(),split_out);
+	}
+
+	void Output_Wumpus::SetFloatInput(const bool enabled)
+	{
+		float_input = enabled;
+		ConfigFile::WriteBoolean(CONF_FLOAT_INPUT, enabled);
+	}
+
+	void Output_Wumpus::SetWriteBatching(const bool enabled)
+	{
+		write_batching = enabled;
+		batch_open = false;
+		ConfigFile::WriteBoolean(CONF_WRITE_BATCH, enabled);
 	}
 
 	void Output_Wumpus::SetXRAMEnabled( const bool enabled )
@@ -3,9 +3,48 @@
 
 #include "Constants.h"
 #include "Framework\Framework.h"
+#include "Out_Stats.h"
+#include "Out_Clock.h"
+#include "Out_Tuner.h"
+#include "Out_Drift.h"
+#include "Out_Position.h"
+#include "Out_Dsp.h"
+#include "Out_Bus.h"
+#include "Out_Upmix.h"
 
 namespace WinampOpenALOut
 {
+	/*
+	 * how a block gets from the ring to the renderers, worked out in
+	 * Open from the expansion and split settings
+	 */
+	typedef enum
+	{
+		// the renderer takes the block straight out of the ring
+		BLOCK_PASS_THROUGH = 0,
+		// expanded to quad in scratch memory
+		BLOCK_EXPAND,
+		// each channel deinterleaved in to scratch memory
+		BLOCK_SPLIT,
+		// every speaker is the same, all renderers share the ring data
+		BLOCK_EXPAND_MONO_SPLIT,
+		// the front pair is deinterleaved and shared with the rear pair
+		BLOCK_EXPAND_STEREO_SPLIT,
+		// through the float bus, whatever the layout, mixed if the
+		// device can't take the stream's channels
+		BLOCK_BUS
+	} block_plan;
+
+	/*
+	 * what to do to the sources of all the renderers at once
+	 */
+	typedef enum
+	{
+		SOURCES_PLAY = 0,
+		SOURCES_PAUSE,
+		SOURCES_STOP
+	} source_command;
+
 #ifndef NATIVE
 	public class Output_Wumpus
 #else
@@ -43,10 +82,43 @@ namespace WinampOpenALOut
 		inline unsigned int	GetSampleRate()				{ return sample_rate; }
 		inline unsigned int GetBitsPerSample()			{ return bits_per_sample; }
 		inline unsigned int GetNumberOfChannels()		{ return number_of_channels; }
-		inline int GetLastOutputTime()					{ return last_output_time; }
-		inline int GetLastWrittenTime()					{ return last_written_time; }
-		inline __int64 GetWrittenBytes()				{ return total_written; }
-		inline __int64 GetPlayedBytes()					{ return total_played; }
+
+		/*
+		 * the position as last published by the audio path, these
+		 * never take the lock so any thread can call them
+		 */
+		inline int GetLastOutputTime()					{ return position.GetOutputTime(); }
+		inline int GetLastWrittenTime()					{ return position.GetWrittenTime(); }
+		inline __int64 GetWrittenBytes()				{ return position.GetWrittenBytes(); }
+		inline __int64 GetPlayedBytes()					{ return position.GetPlayedBytes(); }
+
+		inline bool IsGapless() { return gapless; }
+		void SetGapless(const bool enabled);
+
+		// how long tracks are crossfaded for, 0 if they aren't
+		inline unsigned int GetCrossfadeLength() { return crossfade_ms; }
+		void SetCrossfadeLength(const unsigned int ms);
+
+		// blocks go through the float bus, (frames) at a time
+		inline bool IsFloatBus()						{ return float_bus; }
+		void SetFloatBus(const bool enabled);
+		inline unsigned int GetBusBlockFrames()			{ return bus_block_frames; }
+		void SetBusBlockFrames(const unsigned int frames);
+
+		// stereo is upmixed to 5.1 if the device can play it
+		inline bool IsUpmix()							{ return upmix_enabled; }
+		void SetUpmix(const bool enabled);
+
+		// 32 bit audio from winamp is float rather than integer
+		inline bool IsFloatInput()						{ return float_input; }
+		void SetFloatInput(const bool enabled);
+
+		// CanWrite holds winamp off until it can write a big batch
+		inline bool IsWriteBatching()					{ return write_batching; }
+		void SetWriteBatching(const bool enabled);
+
+		inline bool IsPositionExtrapolated()			{ return position.IsExtrapolated(); }
+		void SetPositionExtrapolated(const bool enabled);
 
 		inline int GetConfBufferLength()				{ return conf_buffer_length;}
 		inline void SetConfBufferLength( const unsigned int i) 
@@ -66,6 +138,22 @@ namespace WinampOpenALOut
 
 		inline bool	IsXRAMPresent() { return xram_detected; }
 
+		inline bool IsThreaded() { return threaded; }
+		void SetThreaded( const bool enabled );
+
+		inline bool IsAutoTuned() { return auto_tune; }
+		void SetAutoTuned( const bool enabled );
+
+		// how far apart the sources are in split mode
+		inline double GetSkewMs() { return drift.GetSkewMs(); }
+
+		// the length of each open al buffer in low latency mode, 0 if off
+		inline unsigned int GetChunkLength() { return chunk_ms; }
+		void SetChunkLength( const unsigned int ms );
+
+		// the body of the worker thread in threaded mode
+		void RunWorker();
+
 		void SetMatrix( const speaker_matrix_T m );
 		inline speaker_matrix_T GetMatrix(void)
 		{
@@ -85,40 +173,150 @@ namespace WinampOpenALOut
 			const int current_position, 
 			const bool is_split);
 
+		void Restart(const int new_time_in_ms);
+
+		bool IsHandingOver();
+		unsigned int GetHeldBytes();
+		unsigned int WriteInput(const char * buf, const unsigned int len);
+		unsigned int WriteFrames(const char * buf, const unsigned int len);
+		unsigned int WriteToRing(const char * buf, const unsigned int len);
+		int GetExpandedChannels(const int numchannels);
+		int GetOutputChannels(const int numchannels);
+		bool CanPlayFloat(const int numchannels);
+		bool CanContinue(
+			const int samplerate,
+			const int numchannels,
+			const int bitspersamp);
+		void Continue();
+
 		void CheckProcessedBuffers();
 		void CheckPlayState();
+		void CheckDrift();
+		void UpdatePosition();
+		void RefreshPosition();
+#ifdef _DEBUGGING
+		void LogStartLatency();
+#endif
 
-		void ExpandMonoToQuad(char ** pbuf, int * plen);
-		void ExpandStereoToQuad(char ** pbuf, int * plen);
-		void SplitAudioToMonoChannels(const char * buf, const int len);
+		int GetSources(ALuint * sources);
+		void ControlSources(
+			const source_command command,
+			const ALuint * sources,
+			const int count);
+		void PlaySources(const ALuint * sources, const int count);
+		void SetSourceGains(const ALfloat gain);
+		void StartRamp(const ALfloat from, const ALfloat to, const bool pause);
+		void AdvanceRamp();
+		bool IsAudible();
+
+		void SubmitBlocks(const bool partial);
+		void SubmitUpmixTail();
+		bool CanSubmitBlock();
+		int GetRendererSpace();
+		int GetWriteSpace(const int space);
+		int GetBatchSpace(const int space);
+		unsigned int GetQueueMaximum();
+
+		void StartWorker();
+		void StopWorker();
+		void PublishState();
+		void SetStreamOpen(const bool open);
+
+		void CheckTuner();
+		void SetQueueLength(const unsigned int ms);
+		void WriteBlock(const char * buf, const int len);
+
+		bool ProcessBlock(
+			const char * buf,
+			const int len,
+			const char ** outputs,
+			int * output_len);
 
 		int SetBufferTime(const int new_ms);
 
 		void SetVolumeInternal(const ALfloat new_volume);
+		bool StoreVolume(const ALfloat new_volume);
 
 			// semaphore for the right access to buffers/open_al api
 		CRITICAL_SECTION critical_section;
-
-		int inline get_current_output_time(
-			const __int64 the_current_output_time, 
-			const unsigned int sample_rate);
-		int inline get_current_written_time(
-			const __int64 the_current_written_time, 
-			const unsigned int sample_rate);
+		// keeps the ring still while Write uses it in threaded mode
+		CRITICAL_SECTION ring_critical_section;
 
 		// boolean to store internal playing state
 		bool			is_playing;
 		// boolean to store if the file steam is open and
-		// thread is running
+		// thread is running. only changed holding both locks
 		bool			stream_open;
 		// boolean for prebuffering state at the start to get as much data
 		// as possible
 		bool			pre_buffer;
-		unsigned int	pre_buffer_number;
+		// how much audio, in ms, is queued before playing starts and
+		// how much after a Flush, when it should start again quickly
+		unsigned int	prebuffer_ms;
+		unsigned int	fast_start_ms;
+		// the frames the current prebuffer needs and has so far
+		unsigned __int64	pre_buffer_target;
+		unsigned __int64	pre_buffer_frames;
+		// the stream has been restarted by Flush
+		bool			restarted;
+		// the sources have been faded out and are faded back in
+		// when they next start
+		bool			ramp_in;
+
+		/*
+		 * the gain ramp in progress, started at (ramp_start) seconds
+		 * (0 for none) going from (ramp_from) to (ramp_to). it's
+		 * stepped along by the worker or winamp's calls, (ramp_pause)
+		 * pauses the sources once it's finished. (source_gain) is
+		 * the gain the sources were last set to
+		 */
+		double			ramp_start;
+		ALfloat			ramp_from;
+		ALfloat			ramp_to;
+		bool			ramp_pause;
+		ALfloat			source_gain;
+
+		/*
+		 * write batching, once CanWrite has said there's no space it
+		 * keeps saying so until the space passes the low watermark,
+		 * (batch_open) while it's offering space. only winamp's
+		 * thread touches these
+		 */
+		bool			write_batching;
+		bool			batch_open;
+
+		/*
+		 * gapless mode, Close leaves the end of the track playing
+		 * (lingering) so a following track in the same format can be
+		 * queued behind it. the renderers count frames from the
+		 * first track, the current one starts at (track_start_frames)
+		 */
+		bool			gapless;
+		bool			lingering;
+		unsigned __int64	track_start_frames;
+
+		/*
+		 * crossfading, the last (fade_bytes) written are held back in
+		 * the ring so the end of a track can be mixed with the start
+		 * of the next. (fade_remaining) bytes of the old track are
+		 * still waiting to be mixed, (fade_position) frames in to a
+		 * fade of (fade_length) frames
+		 */
+		unsigned int	crossfade_ms;
+		unsigned int	fade_bytes;
+		unsigned int	fade_capacity;
+		volatile LONG	fade_remaining;
+		unsigned int	fade_position;
+		unsigned int	fade_length;
+		// when Open or Flush was called, 0 once the sources have started
+		double			start_requested;
 
 		bool			xram_detected;
 		bool			xram_enabled;
 
+		// the sources can be started and stopped as one update
+		bool			deferred_updates;
+
 		// integer to store the sample rate
 		unsigned int	sample_rate;
 		// integer to store the number of channels
@@ -126,6 +324,24 @@ namespace WinampOpenALOut
 		unsigned int	original_number_of_channels;
 		// integer to store the bits per second
 		unsigned int	bits_per_sample;
+
+		/*
+		 * 24 and 32 bit audio from winamp is converted on its way in
+		 * to the ring, to float if open al can take it and to 16 bit
+		 * with dither if not. 8 bit is widened to 16 bit when open al
+		 * has no 8 bit format for the layout. nothing after the ring
+		 * sees anything but (bits_per_sample)
+		 */
+		unsigned int	input_bits_per_sample;
+		bool			converting;
+		bool			widening;
+		bool			float_input;
+		sample_format	input_format;
+		unsigned int	dither[DITHER_LANES];
+		float			convert_buffer[CONVERT_BUFFER_SIZE / FOUR_BYTE_SAMPLE];
+		// the start of a frame winamp hasn't finished writing yet
+		char			partial_frame[INPUT_MAX_FRAME_SIZE];
+		unsigned int	partial_bytes;
 		// integer to store the number of buffers we'll use
 		unsigned int	no_buffers;
 		// integer to store bytes per sample (optimisation
@@ -143,15 +359,66 @@ namespace WinampOpenALOut
 		__int64		total_written;
 		// long int to store time played
 		__int64		total_played;
-		// integer to store the where we are right now
-		__int64		current_output_time;
-		// integer to store the where we've buffered to
-		__int64		current_written_time;
-
-		int			last_output_time;
-		int			last_written_time;
-		char		temp[TEMP_BUFFER_SIZE];
-		int			temp_size;
+		// where we are and where we've buffered to, for any thread
+		Output_Position	position;
+
+		// winamp's data is copied in to here and the renderers
+		// are given whole blocks straight out of it
+		class Output_Ring		*ring;
+		// ring bytes always offered to winamp whatever the queue
+		unsigned int	write_space;
+
+		// scratch memory for expanding and splitting blocks
+		class Output_Arena		*arena;
+
+		block_plan		plan;
+
+		// the float bus, if (float_bus) or the channels have to be
+		// mixed every plan is BLOCK_BUS
+		Output_Bus		bus;
+		bool			float_bus;
+		unsigned int	bus_block_frames;
+
+		// the upmixer on the bus, and how much of the silence that
+		// pushes the end of the stream out of it is still to go
+		Output_Upmix	upmix;
+		bool			upmix_enabled;
+		unsigned int	upmix_tail;
+
+		Output_Stats	stats;
+
+		// the play position given to winamp
+		Output_Clock	clock;
+
+		// set once winamp has run out of data and asks IsPlaying
+		volatile LONG	draining;
+
+		// keeps the sources in step in split mode
+		Output_Drift	drift;
+
+		/*
+		 * low latency mode, every open al buffer holds (chunk_ms)
+		 * of audio and (chunk_count) of them are queued
+		 */
+		unsigned int	chunk_ms;
+		unsigned int	chunk_count;
+
+		// auto tuning of how much audio is queued in open al
+		bool			auto_tune;
+		Output_Tuner	tuner;
+		unsigned int	last_underruns;
+
+		/*
+		 * threaded mode, Write only fills the ring and the worker
+		 * thread does everything with open al. CanWrite and IsPlaying
+		 * answer from the values the worker publishes
+		 */
+		bool			threaded;
+		HANDLE			worker_thread;
+		HANDLE			worker_event;
+		volatile LONG	worker_running;
+		volatile LONG	published_space;
+		volatile LONG	published_playing;
 
 		// used to store the configuration buffer length
 		int	conf_buffer_length;
@@ -24,6 +24,21 @@ void Winamp::Next()
 	PostMessage(theMainWindow, WM_COMMAND,40048,0);
 }
 
+/*
+ * true if winamp will play another track after this one
+ */
+bool Winamp::HasNextTrack()
+{
+	const LRESULT length = SendMessage(theMainWindow, WM_WA_IPC, 0, IPC_GETLISTLENGTH);
+	const LRESULT position = SendMessage(theMainWindow, WM_WA_IPC, 0, IPC_GETLISTPOS);
+	const LRESULT repeat = SendMessage(theMainWindow, WM_WA_IPC, 0, IPC_GET_REPEAT);
+	const LRESULT shuffle = SendMessage(theMainWindow, WM_WA_IPC, 0, IPC_GET_SHUFFLE);
+
+	return repeat != 0 || 
+		(shuffle != 0 && length > 1) ||
+		(position + 1) < length;
+}
+
 void Winamp::Stop()
 {
 	PostMessage(theMainWindow, WM_COMMAND,40047,0);
@@ -11,6 +11,7 @@ public:
 	static int GetTrackLength(void);
 	static void Stop(void);
 	static void Next(void);
+	static bool HasNextTrack(void);
 private:
 	static HWND theMainWindow;
 };